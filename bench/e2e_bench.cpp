@@ -0,0 +1,377 @@
+//
+// @author: jiahong
+// @date  : 27/10/26 9:40 AM
+//
+// End-to-end throughput and scaling harness: runs the immulator executable for every combination of sequence
+// count, thread count and germline configuration, and writes sequences/s, time to the first record, time to the
+// first output block, peak RSS and scaling efficiency as JSON. The compare mode diffs two such files and flags regressions.
+// Usage: immulator_e2e_bench run --immulator PATH [--sizes 1000,...] [--threads 1,2,...] [--config germ.cfg]
+//                                [--repetitions N] [--seed S] [--output results.json]
+//        immulator_e2e_bench compare OLD.json NEW.json [--threshold PERCENT]
+// Like immulator itself, runs expect the germline files in the parent directory.
+//
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "../src/cxxopts.hpp"
+#include "../src/immutils.h"
+
+namespace {
+
+struct Result {
+    std::size_t n = 0;
+    unsigned threads = 0;
+    std::string config;
+    double seconds = 0;
+    double sequences_per_second = 0;
+    // a whole -n 1 run: germline load, one record, exit
+    double first_record_seconds = 0;
+    // until the first FASTA bytes reach the pipe, i.e. once the first output block is full or the run ends
+    double first_block_seconds = 0;
+    long peak_rss_kib = 0;
+    double scaling_efficiency = 0;
+};
+
+struct Sample {
+    double seconds;
+    double first_block_seconds;
+    long peak_rss_kib;
+};
+
+/// runs immulator with args, discarding its FASTA output (but timing its first bytes)
+Sample
+run_once(const std::string &immulator, const std::vector<std::string> &args) {
+    int pipe_fds[2];
+    if (::pipe2(pipe_fds, O_CLOEXEC) != 0) {
+        throw std::runtime_error(std::string("pipe failed: ") + std::strerror(errno));
+    }
+    std::vector<char *> argv;
+    argv.push_back(const_cast<char *>(immulator.c_str()));
+    for (const auto &arg : args) {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    const auto start = std::chrono::steady_clock::now();
+    pid_t pid = ::fork();
+    if (pid < 0) {
+        throw std::runtime_error(std::string("fork failed: ") + std::strerror(errno));
+    } else if (pid == 0) {
+        int null_fd = ::open("/dev/null", O_WRONLY);
+        ::dup2(pipe_fds[1], STDOUT_FILENO);
+        ::dup2(null_fd, STDERR_FILENO);
+        ::execv(immulator.c_str(), argv.data());
+        _exit(127);
+    }
+    ::close(pipe_fds[1]);
+
+    Sample sample{};
+    bool started = false;
+    std::vector<char> buffer(1 << 16);
+    for (;;) {
+        auto n = ::read(pipe_fds[0], buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            break;
+        }
+        if (!started) {
+            started = true;
+            sample.first_block_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+    ::close(pipe_fds[0]);
+    int status;
+    rusage usage{};
+    ::wait4(pid, &status, 0, &usage);
+    sample.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sample.peak_rss_kib = usage.ru_maxrss;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        throw std::runtime_error(immulator + " failed");
+    }
+    return sample;
+}
+
+double
+median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    auto mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+std::string
+json_string(const std::string &str) {
+    std::string quoted = "\"";
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + '"';
+}
+
+/// one result object per line, so that compare() does not need a full JSON parser
+void
+write_results(std::ostream &out, const std::string &immulator, unsigned seed, const std::vector<Result> &results) {
+    char timestamp[32];
+    auto now = std::time(nullptr);
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    out << "{\n"
+        << "  \"immulator\": " << json_string(immulator) << ",\n"
+        << "  \"timestamp\": " << json_string(timestamp) << ",\n"
+        << "  \"cores\": " << std::thread::hardware_concurrency() << ",\n"
+        << "  \"seed\": " << seed << ",\n"
+        << "  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto &r = results[i];
+        out << "    {\"n\": " << r.n << ", \"threads\": " << r.threads << ", \"config\": " << json_string(r.config)
+            << ", \"seconds\": " << r.seconds << ", \"sequences_per_second\": " << r.sequences_per_second
+            << ", \"first_record_seconds\": " << r.first_record_seconds << ", \"first_block_seconds\": "
+            << r.first_block_seconds << ", \"peak_rss_kib\": " << r.peak_rss_kib
+            << ", \"scaling_efficiency\": " << r.scaling_efficiency << '}' << (i + 1 < results.size() ? "," : "")
+            << '\n';
+    }
+    out << "  ]\n}\n";
+}
+
+/// reads back the result objects written by write_results()
+std::vector<Result>
+read_results(const std::string &filename) {
+    std::ifstream in(filename);
+    if (!in) {
+        throw std::runtime_error("cannot read " + filename);
+    }
+    std::vector<Result> results;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.find("{\"n\":") == std::string::npos) {
+            continue;
+        }
+        auto field = [&line](const std::string &key) {
+            auto pos = line.find("\"" + key + "\": ");
+            if (pos == std::string::npos) {
+                throw std::runtime_error("malformed result line: " + line);
+            }
+            pos += key.size() + 4;
+            if (line[pos] == '"') {
+                return line.substr(pos + 1, line.find('"', pos + 1) - pos - 1);
+            }
+            return line.substr(pos, line.find_first_of(",}", pos) - pos);
+        };
+        // metrics added later are 0, which compare() skips, in files written before them
+        auto metric = [&line, &field](const std::string &key) {
+            return line.find("\"" + key + "\": ") == std::string::npos ? 0 : std::stod(field(key));
+        };
+        Result r;
+        r.n = std::stoull(field("n"));
+        r.threads = static_cast<unsigned>(std::stoul(field("threads")));
+        r.config = field("config");
+        r.seconds = std::stod(field("seconds"));
+        r.sequences_per_second = std::stod(field("sequences_per_second"));
+        r.first_record_seconds = metric("first_record_seconds");
+        r.first_block_seconds = metric("first_block_seconds");
+        r.peak_rss_kib = std::stol(field("peak_rss_kib"));
+        r.scaling_efficiency = std::stod(field("scaling_efficiency"));
+        results.push_back(r);
+    }
+    return results;
+}
+
+int
+run(int argc, char *argv[]) {
+    cxxopts::Options options("immulator_e2e_bench run", "Runs immulator end to end and reports JSON");
+    options.add_options()
+            ("immulator", "path of the immulator executable", cxxopts::value<std::string>())
+            ("sizes", "comma separated sequence counts", cxxopts::value<std::string>())
+            ("threads", "comma separated thread counts", cxxopts::value<std::string>())
+            ("config", "also run every combination with this germline configuration", cxxopts::value<std::string>())
+            ("repetitions", "runs per combination (the median is reported), defaults to 3",
+                    cxxopts::value<unsigned>())
+            ("seed", "seed of every run, defaults to 1", cxxopts::value<unsigned>())
+            ("output", "write the JSON here instead of stdout", cxxopts::value<std::string>())
+            ("h,help", "print this help message and exits");
+    auto args = options.parse(argc, argv);
+    if (args.count("help") || !args.count("immulator")) {
+        std::cerr << options.help() << std::endl;
+        return args.count("help") ? 0 : 1;
+    }
+    const auto immulator = args["immulator"].as<std::string>();
+    const auto sizes = immulator::split_string(
+            args.count("sizes") ? args["sizes"].as<std::string>() : "1000,10000,100000,1000000,10000000", ",");
+    std::vector<unsigned> thread_counts;
+    if (args.count("threads")) {
+        for (const auto &t : immulator::split_string(args["threads"].as<std::string>(), ",")) {
+            thread_counts.push_back(static_cast<unsigned>(std::stoul(t)));
+        }
+    } else {
+        for (unsigned t = 1; t <= std::max(1u, std::thread::hardware_concurrency()); t *= 2) {
+            thread_counts.push_back(t);
+        }
+    }
+    std::vector<std::string> configs{""};
+    if (args.count("config")) {
+        configs.push_back(args["config"].as<std::string>());
+    }
+    const unsigned repetitions = args.count("repetitions") ? std::max(1u, args["repetitions"].as<unsigned>()) : 3;
+    const unsigned seed = args.count("seed") ? args["seed"].as<unsigned>() : 1;
+
+    std::vector<Result> results;
+    for (const auto &config : configs) {
+        auto config_args = [&config](std::vector<std::string> run_args) {
+            if (!config.empty()) {
+                run_args.push_back("-g");
+                run_args.push_back(config);
+            }
+            return run_args;
+        };
+        // the first output block fills long after the first record, so time that with separate -n 1 runs
+        std::map<unsigned, double> first_record;
+        for (auto threads : thread_counts) {
+            std::vector<double> seconds;
+            for (unsigned rep = 0; rep < repetitions; ++rep) {
+                seconds.push_back(run_once(immulator, config_args({"-n", "1", "-s", std::to_string(seed), "-t",
+                                                                   std::to_string(threads), "-r", "/dev/null"}))
+                                          .seconds);
+            }
+            first_record[threads] = median(seconds);
+        }
+        for (const auto &size : sizes) {
+            const std::size_t first = results.size();
+            for (auto threads : thread_counts) {
+                const auto run_args = config_args({"-n", size, "-s", std::to_string(seed), "-t",
+                                                   std::to_string(threads), "-r", "/dev/null"});
+                std::vector<double> seconds, first_block;
+                long rss = 0;
+                for (unsigned rep = 0; rep < repetitions; ++rep) {
+                    auto sample = run_once(immulator, run_args);
+                    seconds.push_back(sample.seconds);
+                    first_block.push_back(sample.first_block_seconds);
+                    rss = std::max(rss, sample.peak_rss_kib);
+                }
+                Result r;
+                r.n = std::stoull(size);
+                r.threads = threads;
+                r.config = config;
+                r.seconds = median(seconds);
+                r.sequences_per_second = r.n / r.seconds;
+                r.first_record_seconds = first_record[threads];
+                r.first_block_seconds = median(first_block);
+                r.peak_rss_kib = rss;
+                results.push_back(r);
+                std::cerr << "n=" << size << " threads=" << threads << (config.empty() ? "" : " config=" + config)
+                          << ": " << r.sequences_per_second << " sequences/s\n";
+            }
+            // efficiency against the fewest threads of this group: speedup / thread ratio
+            const auto &base = *std::min_element(results.begin() + first, results.end(),
+                                                 [](const Result &a, const Result &b) {
+                                                     return a.threads < b.threads;
+                                                 });
+            for (auto i = first; i < results.size(); ++i) {
+                results[i].scaling_efficiency = results[i].sequences_per_second / base.sequences_per_second
+                                                * base.threads / results[i].threads;
+            }
+        }
+    }
+    if (args.count("output")) {
+        std::ofstream out(args["output"].as<std::string>());
+        write_results(out, immulator, seed, results);
+    } else {
+        write_results(std::cout, immulator, seed, results);
+    }
+    return 0;
+}
+
+int
+compare(int argc, char *argv[]) {
+    cxxopts::Options options("immulator_e2e_bench compare", "Flags regressions between two result files");
+    options.add_options()
+            ("threshold", "flag changes for the worse of more than this many percent, defaults to 5",
+                    cxxopts::value<double>())
+            ("files", "OLD.json NEW.json", cxxopts::value<std::vector<std::string>>());
+    options.parse_positional({"files"});
+    auto args = options.parse(argc, argv);
+    if (!args.count("files") || args["files"].as<std::vector<std::string>>().size() != 2) {
+        std::cerr << "usage: immulator_e2e_bench compare OLD.json NEW.json [--threshold PERCENT]" << std::endl;
+        return 1;
+    }
+    const auto files = args["files"].as<std::vector<std::string>>();
+    const double threshold = args.count("threshold") ? args["threshold"].as<double>() : 5;
+
+    std::map<std::tuple<std::size_t, unsigned, std::string>, Result> old_results;
+    for (const auto &r : read_results(files[0])) {
+        old_results[std::make_tuple(r.n, r.threads, r.config)] = r;
+    }
+    std::size_t regressions = 0;
+    for (const auto &r : read_results(files[1])) {
+        auto found = old_results.find(std::make_tuple(r.n, r.threads, r.config));
+        if (found == old_results.end()) {
+            continue;
+        }
+        const auto &o = found->second;
+        // percent change for the worse: lower throughput, later first record or block, more memory
+        struct Metric {
+            const char *name;
+            double before;
+            double after;
+            bool higher_is_better;
+        };
+        const Metric metrics[] = {
+                {"sequences_per_second", o.sequences_per_second, r.sequences_per_second, true},
+                {"first_record_seconds", o.first_record_seconds, r.first_record_seconds, false},
+                {"first_block_seconds",  o.first_block_seconds,  r.first_block_seconds,  false},
+                {"peak_rss_kib",         static_cast<double>(o.peak_rss_kib), static_cast<double>(r.peak_rss_kib),
+                                                                                         false},
+        };
+        for (const auto &metric : metrics) {
+            if (metric.before <= 0) {
+                continue;
+            }
+            double change = (metric.after - metric.before) / metric.before * 100;
+            double worse = metric.higher_is_better ? -change : change;
+            bool regressed = worse > threshold;
+            regressions += regressed;
+            std::cout << (regressed ? "REGRESSION " : "ok         ") << "n=" << r.n << " threads=" << r.threads
+                      << (r.config.empty() ? "" : " config=" + r.config) << ' ' << metric.name << ": "
+                      << metric.before << " -> " << metric.after << " (" << (change >= 0 ? "+" : "")
+                      << std::round(change * 10) / 10 << "%)\n";
+        }
+    }
+    std::cout << regressions << " regression(s) above " << threshold << "%" << std::endl;
+    return regressions ? 2 : 0;
+}
+
+}   // namespace
+
+int
+main(int argc, char *argv[]) {
+    const std::string mode = argc > 1 ? argv[1] : "";
+    try {
+        if (mode == "run") {
+            return run(argc - 1, argv + 1);
+        } else if (mode == "compare") {
+            return compare(argc - 1, argv + 1);
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cerr << "usage: immulator_e2e_bench run --immulator PATH [options] | compare OLD.json NEW.json "
+                 "[--threshold PERCENT]" << std::endl;
+    return 1;
+}
@@ -0,0 +1,305 @@
+//
+// @author: jiahong
+// @date  : 29/10/26 2:00 PM
+//
+// Statistical equivalence harness for sampler optimisations: draws n records from the frozen reference engine
+// (src/vdj_reference.h) and n from the live one (Simulator), on independent seeds, and tests that gene usage, trim
+// lengths, insertion lengths, CDR3 length and junction nucleotide composition come from the same distributions
+// (two-sample chi-square on every metric, Kolmogorov-Smirnov on the ordinal ones). Exits with status 2 if any test
+// rejects at the Bonferroni corrected level.
+// Usage: immulator_equivalence [-n 1000000] [-t threads] [-s seed] [-g germ.cfg] [--alpha 0.001]
+//                              [--germlines DIR]
+// 10^7 records per engine take minutes on a many-core machine; 10^6 is enough to catch any gross change.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../src/cxxopts.hpp"
+#include "../src/simulator.h"
+#include "../src/vdj_reference.h"
+
+namespace {
+
+enum Metric : unsigned {
+    V_USAGE,
+    D_USAGE,
+    J_USAGE,
+    V_3P_DEL,
+    D_5P_DEL,
+    D_3P_DEL,
+    J_5P_DEL,
+    NP1_LENGTH,
+    NP2_LENGTH,
+    CDR3_LENGTH,
+    JUNCTION_NTS,
+    NUM_METRICS
+};
+
+const char *const METRIC_NAMES[NUM_METRICS] = {
+        "V usage", "D usage", "J usage", "V 3' deletion", "D 5' deletion", "D 3' deletion", "J 5' deletion",
+        "N1/P insertion", "N2/P insertion", "CDR3 length", "junction nucleotides"
+};
+
+// the values of a categorical metric have no order, so KS does not apply to them
+const bool ORDINAL[NUM_METRICS] = {false, false, false, true, true, true, true, true, true, true, false};
+
+/// histograms of every metric over one engine's records
+struct Tally {
+    std::vector<std::uint64_t> counts[NUM_METRICS];
+
+    void add(Metric metric, std::size_t value, std::uint64_t n = 1) {
+        auto &histogram = counts[metric];
+        if (value >= histogram.size()) {
+            histogram.resize(value + 1);
+        }
+        histogram[value] += n;
+    }
+
+    void add(const immulator::Simulator &pools, const immulator::Recombination &rec) {
+        add(V_USAGE, pools.vgermlines().id(*rec.v));
+        add(D_USAGE, pools.dgermlines().id(*rec.d));
+        add(J_USAGE, pools.jgermlines().id(*rec.j));
+        add(V_3P_DEL, rec.v->size() - rec.v_length);
+        add(D_5P_DEL, rec.d_5p_del);
+        add(D_3P_DEL, rec.d_3p_del);
+        add(J_5P_DEL, rec.j_start);
+        add(NP1_LENGTH, rec.np1_length);
+        add(NP2_LENGTH, rec.np2_length());
+        add(CDR3_LENGTH, rec.cdr3_end - rec.cdr3_start);
+        for (char nt : rec.junction) {
+            add(JUNCTION_NTS, nt == 'A' ? 0 : nt == 'C' ? 1 : nt == 'G' ? 2 : nt == 'T' ? 3 : 4);
+        }
+    }
+
+    void merge(const Tally &other) {
+        for (unsigned m = 0; m < NUM_METRICS; ++m) {
+            for (std::size_t v = 0; v < other.counts[m].size(); ++v) {
+                add(static_cast<Metric>(m), v, other.counts[m][v]);
+            }
+        }
+    }
+};
+
+/// the generator Simulator uses for a block (Simulator::block_generator)
+std::mt19937
+block_generator(unsigned seed, std::size_t block) {
+    std::seed_seq seq{seed, static_cast<unsigned>(block), static_cast<unsigned>(block >> 32)};
+    return std::mt19937(seq);
+}
+
+/// regularised upper incomplete gamma function Q(a, x) (series below a + 1, continued fraction above)
+double
+gamma_q(double a, double x) {
+    if (x <= 0) {
+        return 1;
+    }
+    const double log_prefix = -x + a * std::log(x) - std::lgamma(a);
+    if (x < a + 1) {
+        double term = 1 / a, sum = term;
+        for (double n = a + 1; std::abs(term) > std::abs(sum) * 1e-15; ++n) {
+            term *= x / n;
+            sum += term;
+        }
+        return 1 - sum * std::exp(log_prefix);
+    }
+    constexpr double TINY = std::numeric_limits<double>::min() / std::numeric_limits<double>::epsilon();
+    double b = x + 1 - a, c = 1 / TINY, d = 1 / b, h = d;
+    for (int i = 1; i < 10000; ++i) {
+        double an = -i * (i - a);
+        b += 2;
+        d = an * d + b;
+        d = std::abs(d) < TINY ? TINY : d;
+        c = b + an / c;
+        c = std::abs(c) < TINY ? TINY : c;
+        d = 1 / d;
+        double delta = d * c;
+        h *= delta;
+        if (std::abs(delta - 1) < 1e-15) {
+            break;
+        }
+    }
+    return std::exp(log_prefix) * h;
+}
+
+struct TestResult {
+    double statistic;
+    std::size_t dof;
+    double p;
+};
+
+/// Two-sample chi-square test of homogeneity. Neighbouring values are pooled until every bin holds at least 10
+/// records of both samples together, so that sparse tails do not inflate the statistic.
+TestResult
+chi_square(const std::vector<std::uint64_t> &a, const std::vector<std::uint64_t> &b) {
+    std::vector<std::pair<double, double>> bins;
+    double pending_a = 0, pending_b = 0;
+    for (std::size_t v = 0; v < std::max(a.size(), b.size()); ++v) {
+        pending_a += v < a.size() ? a[v] : 0;
+        pending_b += v < b.size() ? b[v] : 0;
+        if (pending_a + pending_b >= 10) {
+            bins.emplace_back(pending_a, pending_b);
+            pending_a = pending_b = 0;
+        }
+    }
+    if (pending_a + pending_b > 0) {
+        if (bins.empty()) {
+            bins.emplace_back(0, 0);
+        }
+        bins.back().first += pending_a;
+        bins.back().second += pending_b;
+    }
+    double total_a = 0, total_b = 0;
+    for (const auto &bin : bins) {
+        total_a += bin.first;
+        total_b += bin.second;
+    }
+    if (bins.size() < 2 || !total_a || !total_b) {
+        return {0, 0, 1};
+    }
+    const double ka = std::sqrt(total_b / total_a), kb = std::sqrt(total_a / total_b);
+    double statistic = 0;
+    for (const auto &bin : bins) {
+        const double diff = ka * bin.first - kb * bin.second;
+        statistic += diff * diff / (bin.first + bin.second);
+    }
+    const std::size_t dof = bins.size() - 1;
+    return {statistic, dof, gamma_q(dof / 2.0, statistic / 2)};
+}
+
+/// two-sample Kolmogorov-Smirnov test with the asymptotic distribution (conservative for discrete values)
+TestResult
+kolmogorov_smirnov(const std::vector<std::uint64_t> &a, const std::vector<std::uint64_t> &b) {
+    double total_a = 0, total_b = 0;
+    for (auto n : a) {
+        total_a += n;
+    }
+    for (auto n : b) {
+        total_b += n;
+    }
+    if (!total_a || !total_b) {
+        return {0, 0, 1};
+    }
+    double cdf_a = 0, cdf_b = 0, d = 0;
+    for (std::size_t v = 0; v < std::max(a.size(), b.size()); ++v) {
+        cdf_a += (v < a.size() ? a[v] : 0) / total_a;
+        cdf_b += (v < b.size() ? b[v] : 0) / total_b;
+        d = std::max(d, std::abs(cdf_a - cdf_b));
+    }
+    const double ne = std::sqrt(total_a * total_b / (total_a + total_b));
+    const double lambda = (ne + 0.12 + 0.11 / ne) * d;
+    double p = 0, sign = 1;
+    for (int j = 1; j <= 100; ++j) {
+        const double term = sign * 2 * std::exp(-2.0 * j * j * lambda * lambda);
+        p += term;
+        sign = -sign;
+        if (std::abs(term) < 1e-12) {
+            break;
+        }
+    }
+    return {d, 0, lambda < 1e-3 ? 1 : std::min(1.0, std::max(0.0, p))};
+}
+
+}   // namespace
+
+int
+main(int argc, char *argv[]) {
+    cxxopts::Options options("immulator_equivalence",
+                             "Tests that the live samplers draw from the same distributions as the reference engine");
+    options.add_options()
+            ("n,num", "records per engine, defaults to 1000000", cxxopts::value<std::size_t>())
+            ("t,threads", "generator threads, defaults to the number of cores", cxxopts::value<unsigned>())
+            ("s,seed", "seed of the reference engine (the live engine uses seed + 1), defaults to 1",
+                    cxxopts::value<unsigned>())
+            ("g,germlinecfg", "germline configuration file", cxxopts::value<std::string>())
+            ("alpha", "family-wise significance level, defaults to 0.001", cxxopts::value<double>())
+            ("germlines", "directory holding imgt_human_igh[vdj], defaults to ..", cxxopts::value<std::string>())
+            ("h,help", "print this help message and exits");
+    auto args = options.parse(argc, argv);
+    if (args.count("help")) {
+        std::cerr << options.help() << std::endl;
+        return 0;
+    }
+    const std::size_t n = args.count("num") ? args["num"].as<std::size_t>() : 1000000;
+    const unsigned threads = args.count("threads") ? std::max(1u, args["threads"].as<unsigned>())
+                                                   : std::max(1u, std::thread::hardware_concurrency());
+    const unsigned seed = args.count("seed") ? args["seed"].as<unsigned>() : 1;
+    const double alpha = args.count("alpha") ? args["alpha"].as<double>() : 0.001;
+    const std::string dir = args.count("germlines") ? args["germlines"].as<std::string>() : "..";
+    immulator::GermlineConfiguration gcfg;
+    if (args.count("germlinecfg")) {
+        gcfg = immulator::GermlineConfiguration(args["germlinecfg"].as<std::string>(), true);
+    }
+    const immulator::Simulator simulator(dir + "/imgt_human_ighv", dir + "/imgt_human_ighd",
+                                         dir + "/imgt_human_ighj", gcfg, seed + 1);
+
+    // both engines generate the same blocks, so every thread does an even share of the work of each
+    const std::size_t nblocks = (n + immulator::Simulator::BLOCK_SIZE - 1) / immulator::Simulator::BLOCK_SIZE;
+    std::atomic<std::size_t> next_block{0};
+    std::vector<Tally> reference_tallies(threads), live_tallies(threads);
+    const auto start = std::chrono::steady_clock::now();
+    auto worker = [&](unsigned t) {
+        std::vector<immulator::Recombination> records;
+        for (std::size_t block; (block = next_block++) < nblocks;) {
+            const auto count = std::min(immulator::Simulator::BLOCK_SIZE,
+                                        n - block * immulator::Simulator::BLOCK_SIZE);
+            auto generator = block_generator(seed, block);
+            for (std::size_t i = 0; i < count; ++i) {
+                reference_tallies[t].add(simulator, immulator::reference::recombine(
+                        simulator.vgermlines(), simulator.dgermlines(), simulator.jgermlines(), generator));
+            }
+            simulator.generate_block(block, count, records);
+            for (const auto &rec : records) {
+                live_tallies[t].add(simulator, rec);
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t) {
+        pool.emplace_back(worker, t);
+    }
+    for (auto &thread : pool) {
+        thread.join();
+    }
+    for (unsigned t = 1; t < threads; ++t) {
+        reference_tallies[0].merge(reference_tallies[t]);
+        live_tallies[0].merge(live_tallies[t]);
+    }
+    const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "generated " << n << " records per engine with " << threads << " thread(s) in " << seconds
+              << " s\n";
+
+    std::vector<std::pair<Metric, bool>> tests;
+    for (unsigned m = 0; m < NUM_METRICS; ++m) {
+        tests.emplace_back(static_cast<Metric>(m), false);
+        if (ORDINAL[m]) {
+            tests.emplace_back(static_cast<Metric>(m), true);
+        }
+    }
+    const double level = alpha / tests.size();
+    std::size_t rejected = 0;
+    std::cout << std::left << std::setw(24) << "metric" << std::setw(6) << "test" << std::right << std::setw(14)
+              << "statistic" << std::setw(6) << "dof" << std::setw(14) << "p" << "  verdict\n";
+    for (const auto &test : tests) {
+        const auto &a = reference_tallies[0].counts[test.first];
+        const auto &b = live_tallies[0].counts[test.first];
+        const auto result = test.second ? kolmogorov_smirnov(a, b) : chi_square(a, b);
+        const bool same = result.p >= level;
+        rejected += !same;
+        std::cout << std::left << std::setw(24) << METRIC_NAMES[test.first] << std::setw(6)
+                  << (test.second ? "KS" : "chi2") << std::right << std::setw(14) << std::setprecision(6)
+                  << result.statistic << std::setw(6) << result.dof << std::setw(14) << result.p << "  "
+                  << (same ? "same" : "DIFFERENT") << '\n';
+    }
+    std::cout << tests.size() << " tests at " << level << " each (family-wise " << alpha << "): " << rejected
+              << " rejected" << std::endl;
+    return rejected ? 2 : 0;
+}
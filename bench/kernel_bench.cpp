@@ -0,0 +1,214 @@
+//
+// @author: jiahong
+// @date  : 26/10/26 3:05 PM
+//
+// Micro-benchmarks of the recombination kernels (Google Benchmark). Every benchmark draws from its own generator
+// with a fixed seed and cycles through the germlines in file order, so runs are comparable between builds.
+// Usage: immulator_bench [benchmark options] [germline directory [germline configuration]]
+// The germline directory (holding imgt_human_igh[vdj]) defaults to "..", as for immulator itself; without a
+// configuration file, one favouring the first three V genes 70/20/10 is made up from the V pool.
+//
+
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include "../src/germline_factory.h"
+#include "../src/vdj.h"
+
+namespace {
+
+constexpr unsigned SEED = 42;
+
+// heavy chain FR4 consensus jcutter aligns J germlines against
+const std::string FR4_AA = "WGQGTXVTVSS";
+const std::string FR4_DNA = "TGGGGCCAGGGCACCNNNGTGACCGTGAGCAGC";
+
+immulator::GermlineConfiguration gcfg;
+std::unique_ptr<immulator::GermlineFactory> vgermlines;
+std::unique_ptr<immulator::GermlineFactory> dgermlines;
+std::unique_ptr<immulator::GermlineFactory> jgermlines;
+std::unique_ptr<immulator::GermlineFactory> configured_vgermlines;
+
+/// the next germline of pool, round robin
+const immulator::Germline &
+next(const immulator::GermlineFactory &pool, std::size_t &i) {
+    const auto &germlines = pool.germlines();
+    return germlines[i++ % germlines.size()];
+}
+
+void
+BM_translate(benchmark::State &state) {
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(immulator::translate(next(*vgermlines, i).sequence()));
+    }
+}
+BENCHMARK(BM_translate);
+
+void
+BM_local_align_aa(benchmark::State &state) {
+    std::vector<std::string> translated;
+    for (const auto &germ : jgermlines->germlines()) {
+        translated.push_back(immulator::translate(germ.sequence()));
+    }
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(immulator::local_align(translated[i++ % translated.size()], FR4_AA, -5, -5,
+                                                        immulator::blosum62()));
+    }
+}
+BENCHMARK(BM_local_align_aa);
+
+void
+BM_local_align_nt(benchmark::State &state) {
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(immulator::local_align(next(*jgermlines, i).sequence(), FR4_DNA, -5, -5,
+                                                        immulator::nt_scoring_matrix()));
+    }
+}
+BENCHMARK(BM_local_align_nt);
+
+void
+BM_allowed_nts(benchmark::State &state) {
+    const std::string rem = std::string("TA").substr(0, static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(immulator::allowed_nts(rem));
+    }
+}
+BENCHMARK(BM_allowed_nts)->DenseRange(0, 2);
+
+void
+BM_vcutter(benchmark::State &state) {
+    std::mt19937 generator(SEED);
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(immulator::vcutter(next(*vgermlines, i), generator));
+    }
+}
+BENCHMARK(BM_vcutter);
+
+void
+BM_dcutter(benchmark::State &state) {
+    std::mt19937 generator(SEED);
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(immulator::dcutter(next(*dgermlines, i), generator, "", true));
+    }
+}
+BENCHMARK(BM_dcutter);
+
+void
+BM_jcutter(benchmark::State &state) {
+    std::mt19937 generator(SEED);
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(immulator::jcutter(next(*jgermlines, i), generator, "", 0, true));
+    }
+}
+BENCHMARK(BM_jcutter);
+
+/// state.range(0) nucleotides, state.range(1) productive
+void
+BM_palindromic(benchmark::State &state) {
+    std::mt19937 generator(SEED);
+    const auto n = static_cast<std::string::size_type>(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(immulator::palindromic(n, generator, "", state.range(1) != 0));
+    }
+}
+BENCHMARK(BM_palindromic)->ArgsProduct({{2, 4, 8}, {0, 1}});
+
+/// state.range(0) nucleotides, state.range(1) productive
+void
+BM_random_nts(benchmark::State &state) {
+    std::mt19937 generator(SEED);
+    const auto n = static_cast<std::string::size_type>(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(immulator::random_nts(n, generator, "", state.range(1) != 0));
+    }
+}
+BENCHMARK(BM_random_nts)->ArgsProduct({{1, 5}, {0, 1}});
+
+void
+BM_germline_factory(benchmark::State &state) {
+    std::mt19937 generator(SEED);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(&(*vgermlines)(generator));
+    }
+}
+BENCHMARK(BM_germline_factory);
+
+void
+BM_germline_factory_config(benchmark::State &state) {
+    std::mt19937 generator(SEED);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(&(*configured_vgermlines)(generator));
+    }
+}
+BENCHMARK(BM_germline_factory_config);
+
+void
+BM_next_roll(benchmark::State &state) {
+    std::mt19937 generator(SEED);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(gcfg.next_roll(generator));
+    }
+}
+BENCHMARK(BM_next_roll);
+
+void
+BM_vdj_recombination(benchmark::State &state) {
+    std::mt19937 generator(SEED);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(immulator::vdj_recombination((*vgermlines)(generator), (*dgermlines)(generator),
+                                                              (*jgermlines)(generator), generator));
+    }
+}
+BENCHMARK(BM_vdj_recombination);
+
+}   // namespace
+
+int
+main(int argc, char *argv[]) {
+    benchmark::Initialize(&argc, argv);
+    const std::string directory = argc > 1 ? argv[1] : "..";
+    vgermlines.reset(new immulator::GermlineFactory(directory + "/imgt_human_ighv", false));
+    dgermlines.reset(new immulator::GermlineFactory(directory + "/imgt_human_ighd", false));
+    jgermlines.reset(new immulator::GermlineFactory(directory + "/imgt_human_ighj", false));
+    if (vgermlines->germlines().empty() || dgermlines->germlines().empty() || jgermlines->germlines().empty()) {
+        std::cerr << "no germlines found in " << directory << '\n';
+        return 1;
+    }
+
+    std::string config = argc > 2 ? argv[2] : "";
+    if (config.empty()) {
+        char made_up[] = "/tmp/immulator_bench_XXXXXX";
+        int fd = ::mkstemp(made_up);
+        if (fd < 0) {
+            std::perror("mkstemp");
+            return 1;
+        }
+        ::close(fd);
+        config = made_up;
+        std::ofstream out(config);
+        const int shares[] = {70, 20, 10};
+        for (std::size_t i = 0; i < 3 && i < vgermlines->germlines().size(); ++i) {
+            out << vgermlines->germlines()[i].gene_name() << ',' << shares[i] << '\n';
+        }
+    }
+    gcfg = immulator::GermlineConfiguration(config, true);
+    configured_vgermlines.reset(new immulator::GermlineFactory(*vgermlines, gcfg));
+    if (argc <= 2) {
+        std::remove(config.c_str());
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
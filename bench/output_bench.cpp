@@ -0,0 +1,70 @@
+//
+// @author: jiahong
+// @date  : 20/10/26 6:15 PM
+//
+// Compares the plain buffered write(2) path against the io_uring sink by streaming synthetic FASTA records to a
+// file. Usage: immulator_output_bench [directory] [megabytes] [repetitions]
+//
+
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include "../src/uring.h"
+#include "../src/writer.h"
+
+namespace {
+
+// formats the same ~360 byte records the simulator writes, without running the simulation itself
+double
+run(std::unique_ptr<immulator::OutputSink> sink, const std::vector<std::string> &records, std::size_t bytes) {
+    auto start = std::chrono::steady_clock::now();
+    immulator::BufferedWriter out(std::move(sink));
+    std::size_t written = 0;
+    for (std::size_t i = 0; written < bytes; ++i) {
+        const auto &record = records[i % records.size()];
+        out.put('>');
+        out.write_uint(i);
+        out.put('|');
+        out.write(record);
+        written += record.size();
+    }
+    out.close();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(bytes) / (1 << 20) / elapsed.count();
+}
+
+}   // namespace
+
+int
+main(int argc, char *argv[]) {
+    const std::string directory = argc > 1 ? argv[1] : ".";
+    const std::size_t megabytes = argc > 2 ? std::stoul(argv[2]) : 1024;
+    const int repetitions = argc > 3 ? std::stoi(argv[3]) : 3;
+    const std::string filename = directory + "/immulator_output_bench.tmp";
+
+    std::mt19937 mersenne(42);
+    std::uniform_int_distribution<int> nt(0, 3);
+    std::vector<std::string> records;
+    for (int i = 0; i < 1024; ++i) {
+        std::string record = "IGHV3-23*01,IGHD3-10*01,IGHJ4*02\n";
+        for (int j = 0; j < 360; ++j) {
+            record += "ACGT"[nt(mersenne)];
+        }
+        record += '\n';
+        records.push_back(record);
+    }
+
+    const std::size_t bytes = megabytes << 20;
+    for (int rep = 0; rep < repetitions; ++rep) {
+        auto buffered = run(std::make_unique<immulator::FileSink>(filename), records, bytes);
+        auto uring_sink = immulator::make_uring_sink(immulator::open_output_file(filename), true);
+        bool has_uring = dynamic_cast<immulator::UringSink *>(uring_sink.get()) != nullptr;
+        auto uring = run(std::move(uring_sink), records, bytes);
+        std::cout << "run " << rep << ": buffered write(2) " << buffered << " MiB/s, io_uring"
+                  << (has_uring ? "" : " (unavailable, fell back to write(2))") << ' ' << uring << " MiB/s\n";
+    }
+    ::unlink(filename.c_str());
+    return 0;
+}
@@ -0,0 +1,150 @@
+//
+// @author: jiahong
+// @date  : 23/10/26 9:30 AM
+//
+
+#include "airr.h"
+#include "immutils.h"
+
+namespace immulator {
+
+namespace {
+
+/// appends record's nucleotides [from, to) to out
+void
+append_range(std::string &out, const immulator::Recombination &record, std::size_t from, std::size_t to) {
+    const std::size_t j_begin = record.v_length + record.junction.size();
+    if (from < record.v_length) {
+        out.append(record.v_data() + from, std::min<std::size_t>(to, record.v_length) - from);
+    }
+    if (from < j_begin && to > record.v_length) {
+        auto begin = std::max<std::size_t>(from, record.v_length) - record.v_length;
+        out.append(record.junction, begin, std::min(to, j_begin) - record.v_length - begin);
+    }
+    if (to > j_begin) {
+        auto begin = std::max(from, j_begin) - j_begin;
+        out.append(record.j_data() + begin, to - j_begin - begin);
+    }
+}
+
+}   // namespace
+
+constexpr const char AirrWriter::HEADER[];
+
+void
+AirrWriter::write(std::size_t index, const immulator::Recombination &record) {
+    if (!header_written_) {
+        header_written_ = true;
+        out_.write(HEADER, sizeof(HEADER) - 1);
+    }
+    const std::size_t size = record.size();
+    const std::size_t j_begin = record.v_length + record.junction.size();
+    const std::size_t d_begin = record.v_length + record.np1_length;
+    const std::size_t d_length = record.emitted_d_length();
+    // the AIRR junction spans CDR3 plus the conserved Cys and Trp/Phe codons on either side
+    const std::size_t junction_begin = std::min(size, static_cast<std::size_t>(record.cdr3_start) - 4);
+    const std::size_t junction_end = std::min(size, static_cast<std::size_t>(record.cdr3_end) + 3);
+
+    junction_.clear();
+    append_range(junction_, record, junction_begin, junction_end);
+    const auto junction_aa = immulator::translate(junction_);
+    const bool productive = junction_.size() % 3 == 0 && junction_aa.find('*') == std::string::npos;
+
+    out_.write_uint(index);
+    tab();
+    out_.write(record.v_data(), record.v_length);
+    out_.write(record.junction);
+    out_.write(record.j_data(), record.j_length);
+    tab();
+    out_.put('F');
+    tab();
+    out_.put(productive ? 'T' : 'F');
+    tab();
+    out_.write(record.v->name());
+    tab();
+    if (d_length) {
+        out_.write(record.d->name());
+    }
+    tab();
+    out_.write(record.j->name());
+    // no gapped alignments
+    tab();
+    tab();
+    tab();
+    out_.write(junction_);
+    tab();
+    out_.write(junction_aa);
+
+    tab();
+    write_op(record.v_length, 'M');
+    write_op(size - record.v_length, 'S');
+    tab();
+    if (d_length) {
+        write_op(d_begin, 'S');
+        write_op(record.d_5p_del, 'N');
+        write_op(d_length, 'M');
+        write_op(size - d_begin - d_length, 'S');
+    }
+    tab();
+    write_op(j_begin, 'S');
+    write_op(record.j_start, 'N');
+    write_op(record.j_length, 'M');
+
+    tab();
+    out_.write_uint(1);
+    tab();
+    out_.write_uint(record.v_length);
+    tab();
+    out_.write_uint(1);
+    tab();
+    out_.write_uint(record.v_length);
+    tab();
+    if (d_length) {
+        out_.write_uint(d_begin + 1);
+        tab();
+        out_.write_uint(d_begin + d_length);
+        tab();
+        out_.write_uint(record.d_5p_del + 1);
+        tab();
+        out_.write_uint(record.d_5p_del + d_length);
+    } else {
+        tab();
+        tab();
+    }
+    tab();
+    out_.write_uint(j_begin + 1);
+    tab();
+    out_.write_uint(size);
+    tab();
+    out_.write_uint(record.j_start + 1);
+    tab();
+    out_.write_uint(record.j_start + record.j_length);
+
+    tab();
+    out_.write_uint(record.np1_length);
+    tab();
+    out_.write_uint(record.np2_length());
+    tab();
+    out_.write_uint(record.v->size() - record.v_length);
+    tab();
+    out_.write_uint(record.d_5p_del);
+    tab();
+    out_.write_uint(record.d_3p_del + (record.d_length - d_length));
+    tab();
+    out_.write_uint(record.j_start);
+    tab();
+    out_.write_uint(record.cdr3_start);
+    tab();
+    out_.write_uint(record.cdr3_end);
+    out_.put('\n');
+}
+
+void
+AirrWriter::write_op(std::size_t length, char op) {
+    if (length) {
+        out_.write_uint(length);
+        out_.put(op);
+    }
+}
+
+}   // namespace immulator
@@ -0,0 +1,49 @@
+//
+// @author: jiahong
+// @date  : 23/10/26 9:30 AM
+//
+
+#ifndef IMMULATOR_AIRR_H
+#define IMMULATOR_AIRR_H
+
+#include <string>
+#include "writer.h"
+
+namespace immulator {
+
+/// Writes the truth table as an AIRR rearrangement TSV: calls, junction, CIGARs, segment boundaries in the
+/// sequence (1-indexed, inclusive) and in the germlines, N/P lengths and trims, straight from the recombination,
+/// so no annotator has to be run over the output to recover them. Columns that have no value (e.g. the D fields
+/// when D was trimmed away entirely) are left empty. Besides the AIRR fields, v_3p_del, d_5p_del, d_3p_del and
+/// j_5p_del give the trims directly.
+class AirrWriter : public RecordWriter {
+public:
+    static constexpr const char HEADER[] =
+            "sequence_id\tsequence\trev_comp\tproductive\tv_call\td_call\tj_call\tsequence_alignment\t"
+            "germline_alignment\tjunction\tjunction_aa\tv_cigar\td_cigar\tj_cigar\t"
+            "v_sequence_start\tv_sequence_end\tv_germline_start\tv_germline_end\t"
+            "d_sequence_start\td_sequence_end\td_germline_start\td_germline_end\t"
+            "j_sequence_start\tj_sequence_end\tj_germline_start\tj_germline_end\t"
+            "np1_length\tnp2_length\tv_3p_del\td_5p_del\td_3p_del\tj_5p_del\tcdr3_start\tcdr3_end\n";
+
+    /// \param out buffered output stream
+    explicit AirrWriter(BufferedWriter &out) : out_(out) {}
+
+    void write(std::size_t index, const immulator::Recombination &record) override;
+
+private:
+    /// writes a CIGAR operation, unless its length is 0
+    void write_op(std::size_t length, char op);
+
+    void tab() { out_.put('\t'); }
+
+private:
+    BufferedWriter &out_;
+    bool header_written_ = false;
+    // junction of the current record, kept around to translate it
+    std::string junction_;
+};
+
+}   // namespace immulator
+
+#endif //IMMULATOR_AIRR_H
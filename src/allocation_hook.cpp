@@ -0,0 +1,100 @@
+//
+// @author: jiahong
+// @date  : 29/10/26 9:30 AM
+//
+
+// Replacements of the global operator new/delete that feed the allocation counters of --stats. Only the executable
+// links this file (IMMULATOR_ALLOCATION_STATS), the library never replaces the allocator of its host. While --stats
+// is off, each call costs a test of stats::collecting on top of malloc/free.
+
+#include <malloc.h>
+#include <cstdlib>
+#include <new>
+#include "stats.h"
+
+namespace {
+
+void *
+allocate(std::size_t size) {
+    for (;;) {
+        if (void *p = std::malloc(size ? size : 1)) {
+            if (immulator::stats::collecting) {
+                immulator::stats::allocated(malloc_usable_size(p));
+            }
+            return p;
+        }
+        auto handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void
+deallocate(void *p) noexcept {
+    if (p && immulator::stats::collecting) {
+        immulator::stats::deallocated(malloc_usable_size(p));
+    }
+    std::free(p);
+}
+
+}   // namespace
+
+void *
+operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void *
+operator new[](std::size_t size) {
+    return allocate(size);
+}
+
+void *
+operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return allocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void *
+operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return allocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void
+operator delete(void *p) noexcept {
+    deallocate(p);
+}
+
+void
+operator delete[](void *p) noexcept {
+    deallocate(p);
+}
+
+void
+operator delete(void *p, std::size_t) noexcept {
+    deallocate(p);
+}
+
+void
+operator delete[](void *p, std::size_t) noexcept {
+    deallocate(p);
+}
+
+void
+operator delete(void *p, const std::nothrow_t &) noexcept {
+    deallocate(p);
+}
+
+void
+operator delete[](void *p, const std::nothrow_t &) noexcept {
+    deallocate(p);
+}
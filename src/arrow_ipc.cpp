@@ -0,0 +1,444 @@
+//
+// @author: jiahong
+// @date  : 23/10/26 3:10 PM
+//
+
+#include <algorithm>
+#include <iostream>
+#include "arrow_ipc.h"
+
+namespace immulator {
+
+namespace {
+
+/// Just enough of a FlatBuffers builder for the Arrow metadata. Like the real one it builds back to front, so
+/// every object is finished before the objects referring to it; an Offset is the distance of an object from the
+/// end of the buffer. Bytes are kept in reverse order until finish().
+class FlatBuilder {
+public:
+    using Offset = uint32_t;
+
+    Offset size() const { return static_cast<Offset>(bytes_.size()); }
+
+    void align(std::size_t alignment) {
+        while (bytes_.size() % alignment) {
+            bytes_.push_back(0);
+        }
+    }
+
+    /// prepends the size lowest bytes of value, little endian
+    void prepend(uint64_t value, std::size_t size) {
+        for (std::size_t i = size; i-- > 0;) {
+            bytes_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    Offset string(const std::string &str) {
+        // the length prefix must end up 4-byte aligned
+        while ((bytes_.size() + str.size() + 1) % 4) {
+            bytes_.push_back(0);
+        }
+        bytes_.push_back(0);
+        bytes_.insert(bytes_.end(), str.rbegin(), str.rend());
+        prepend(str.size(), 4);
+        return size();
+    }
+
+    Offset offsets(const std::vector<Offset> &targets) {
+        align(4);
+        for (auto target = targets.rbegin(); target != targets.rend(); ++target) {
+            prepend(size() + 4 - *target, 4);
+        }
+        prepend(targets.size(), 4);
+        return size();
+    }
+
+    /// vector of count structs, data holds them in memory order
+    Offset structs(const std::vector<uint8_t> &data, std::size_t count, std::size_t alignment = 8) {
+        while ((bytes_.size() + data.size()) % alignment) {
+            bytes_.push_back(0);
+        }
+        bytes_.insert(bytes_.end(), data.rbegin(), data.rend());
+        prepend(count, 4);
+        return size();
+    }
+
+    void start_table() {
+        fields_.clear();
+    }
+
+    template<typename T>
+    void add(uint16_t id, T value) {
+        fields_.push_back({id, sizeof(T), static_cast<uint64_t>(value), false});
+    }
+
+    void add_offset(uint16_t id, Offset target) {
+        fields_.push_back({id, 4, target, true});
+    }
+
+    Offset end_table() {
+        const auto end = size();
+        std::stable_sort(fields_.begin(), fields_.end(), [](const Field &a, const Field &b) {
+            return a.size > b.size;
+        });
+        std::vector<std::pair<uint16_t, Offset>> positions;
+        uint16_t slots = 0;
+        for (const auto &field : fields_) {
+            align(field.size);
+            prepend(field.offset ? size() + 4 - field.value : field.value, field.size);
+            positions.emplace_back(field.id, size());
+            slots = std::max<uint16_t>(slots, field.id + 1);
+        }
+        // the table starts with the (signed) distance back to its vtable, patched in below
+        align(4);
+        prepend(0, 4);
+        const auto table = size();
+        std::vector<uint16_t> vtable(slots, 0);
+        for (const auto &position : positions) {
+            vtable[position.first] = static_cast<uint16_t>(table - position.second);
+        }
+        for (auto slot = vtable.rbegin(); slot != vtable.rend(); ++slot) {
+            prepend(*slot, 2);
+        }
+        prepend(table - end, 2);
+        prepend(4 + 2 * slots, 2);
+        const uint32_t distance = size() - table;
+        for (std::size_t k = 0; k < 4; ++k) {
+            bytes_[table - 1 - k] = static_cast<uint8_t>(distance >> (8 * k));
+        }
+        return table;
+    }
+
+    std::vector<uint8_t> finish(Offset root) {
+        while ((bytes_.size() + 4) % 8) {
+            bytes_.push_back(0);
+        }
+        prepend(size() + 4 - root, 4);
+        return std::vector<uint8_t>(bytes_.rbegin(), bytes_.rend());
+    }
+
+private:
+    struct Field {
+        uint16_t id;
+        std::size_t size;
+        uint64_t value;
+        bool offset;
+    };
+
+    std::vector<uint8_t> bytes_;
+    std::vector<Field> fields_;
+};
+
+// Arrow format constants (Schema.fbs, Message.fbs)
+constexpr int16_t METADATA_V5 = 4;
+constexpr uint8_t HEADER_SCHEMA = 1;
+constexpr uint8_t HEADER_DICTIONARY_BATCH = 2;
+constexpr uint8_t HEADER_RECORD_BATCH = 3;
+constexpr uint8_t TYPE_INT = 2;
+constexpr uint8_t TYPE_UTF8 = 5;
+constexpr char MAGIC[] = "ARROW1";
+constexpr uint32_t CONTINUATION = 0xffffffff;
+constexpr std::size_t ALIGNMENT = 8;
+
+const std::array<const char *, 3> CALL_COLUMNS = {"v_call", "d_call", "j_call"};
+
+FlatBuilder::Offset
+int_type(FlatBuilder &fb, int32_t bit_width) {
+    fb.start_table();
+    fb.add<int32_t>(0, bit_width);
+    fb.add<uint8_t>(1, 1);
+    return fb.end_table();
+}
+
+FlatBuilder::Offset
+field(FlatBuilder &fb, const std::string &name, bool dictionary_encoded, int64_t dictionary_id, int32_t bit_width) {
+    auto name_offset = fb.string(name);
+    FlatBuilder::Offset type;
+    FlatBuilder::Offset dictionary = 0;
+    if (dictionary_encoded) {
+        fb.start_table();
+        type = fb.end_table();
+        auto index_type = int_type(fb, 32);
+        fb.start_table();
+        fb.add<int64_t>(0, dictionary_id);
+        fb.add_offset(1, index_type);
+        dictionary = fb.end_table();
+    } else {
+        type = int_type(fb, bit_width);
+    }
+    auto children = fb.offsets({});
+    fb.start_table();
+    fb.add_offset(0, name_offset);
+    fb.add<uint8_t>(1, 0);
+    fb.add<uint8_t>(2, dictionary_encoded ? TYPE_UTF8 : TYPE_INT);
+    fb.add_offset(3, type);
+    if (dictionary_encoded) {
+        fb.add_offset(4, dictionary);
+    }
+    fb.add_offset(5, children);
+    return fb.end_table();
+}
+
+FlatBuilder::Offset
+schema(FlatBuilder &fb) {
+    std::vector<FlatBuilder::Offset> fields;
+    fields.push_back(field(fb, "sequence_id", false, 0, 64));
+    for (std::size_t i = 0; i < CALL_COLUMNS.size(); ++i) {
+        fields.push_back(field(fb, CALL_COLUMNS[i], true, static_cast<int64_t>(i), 32));
+    }
+    for (auto name : ArrowFile::POSITION_COLUMNS) {
+        fields.push_back(field(fb, name, false, 0, 32));
+    }
+    auto field_vector = fb.offsets(fields);
+    fb.start_table();
+    fb.add<int16_t>(0, 0);
+    fb.add_offset(1, field_vector);
+    return fb.end_table();
+}
+
+std::vector<uint8_t>
+message(FlatBuilder &fb, uint8_t header_type, FlatBuilder::Offset header, std::size_t body_length) {
+    fb.start_table();
+    fb.add<int16_t>(0, METADATA_V5);
+    fb.add<uint8_t>(1, header_type);
+    fb.add_offset(2, header);
+    fb.add<int64_t>(3, static_cast<int64_t>(body_length));
+    return fb.finish(fb.end_table());
+}
+
+void
+put_le(std::vector<uint8_t> &out, uint64_t value, std::size_t size) {
+    for (std::size_t i = 0; i < size; ++i) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+/// Body of a record batch: every column is a (zero length) validity bitmap plus its data buffers, each buffer
+/// padded to ALIGNMENT. Collects the FieldNode and Buffer structs the metadata describes it with.
+class Body {
+public:
+    void add_node(std::size_t length) {
+        put_le(nodes_, length, 8);
+        put_le(nodes_, 0, 8);
+        ++node_count_;
+    }
+
+    void add_buffer(const void *data, std::size_t size) {
+        put_le(buffers_, bytes_.size(), 8);
+        put_le(buffers_, size, 8);
+        ++buffer_count_;
+        bytes_.insert(bytes_.end(), static_cast<const char *>(data), static_cast<const char *>(data) + size);
+        bytes_.resize((bytes_.size() + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT, 0);
+    }
+
+    template<typename T>
+    void add_column(const std::vector<T> &values) {
+        add_node(values.size());
+        add_buffer(nullptr, 0);
+        add_buffer(values.data(), values.size() * sizeof(T));
+    }
+
+    /// builds the RecordBatch table
+    FlatBuilder::Offset record_batch(FlatBuilder &fb, std::size_t length) const {
+        auto buffers = fb.structs(buffers_, buffer_count_);
+        auto nodes = fb.structs(nodes_, node_count_);
+        fb.start_table();
+        fb.add<int64_t>(0, static_cast<int64_t>(length));
+        fb.add_offset(1, nodes);
+        fb.add_offset(2, buffers);
+        return fb.end_table();
+    }
+
+    const std::vector<char> &bytes() const { return bytes_; }
+
+private:
+    std::vector<uint8_t> nodes_;
+    std::vector<uint8_t> buffers_;
+    std::size_t node_count_ = 0;
+    std::size_t buffer_count_ = 0;
+    std::vector<char> bytes_;
+};
+
+}   // namespace
+
+const std::array<const char *, ArrowBatch::NUM_POSITION_COLUMNS> ArrowFile::POSITION_COLUMNS = {
+        "cdr3_start", "cdr3_end", "sequence_length", "v_sequence_end", "np1_length", "d_length", "np2_length",
+        "j_length", "v_3p_del", "d_5p_del", "d_3p_del", "j_5p_del"
+};
+
+void
+ArrowBatch::clear() {
+    sequence_id.clear();
+    for (auto &column : calls) {
+        column.clear();
+    }
+    for (auto &column : positions) {
+        column.clear();
+    }
+}
+
+ArrowFile::ArrowFile(const std::string &filename, const immulator::GermlineFactory &vgermlines,
+                     const immulator::GermlineFactory &dgermlines, const immulator::GermlineFactory &jgermlines) :
+        vgermlines_(vgermlines), dgermlines_(dgermlines), jgermlines_(jgermlines), sink_(filename) {
+    // magic padded to 8 bytes
+    const char magic[8] = {'A', 'R', 'R', 'O', 'W', '1', 0, 0};
+    sink_.write(magic, sizeof(magic));
+    offset_ = sizeof(magic);
+    {
+        FlatBuilder fb;
+        write_message(message(fb, HEADER_SCHEMA, schema(fb), 0), {});
+    }
+    // one dictionary of germline names per pool: ids are the positions in the pool
+    const immulator::GermlineFactory *pools[] = {&vgermlines_, &dgermlines_, &jgermlines_};
+    for (std::size_t i = 0; i < CALL_COLUMNS.size(); ++i) {
+        std::vector<int32_t> offsets{0};
+        std::string names;
+        for (const auto &germ : pools[i]->germlines()) {
+            names += germ.name();
+            offsets.push_back(static_cast<int32_t>(names.size()));
+        }
+        Body body;
+        body.add_node(offsets.size() - 1);
+        body.add_buffer(nullptr, 0);
+        body.add_buffer(offsets.data(), offsets.size() * sizeof(int32_t));
+        body.add_buffer(names.data(), names.size());
+
+        FlatBuilder fb;
+        auto data = body.record_batch(fb, offsets.size() - 1);
+        fb.start_table();
+        fb.add<int64_t>(0, static_cast<int64_t>(i));
+        fb.add_offset(1, data);
+        auto dictionary_batch = fb.end_table();
+        dictionaries_.push_back(write_message(message(fb, HEADER_DICTIONARY_BATCH, dictionary_batch,
+                                                      body.bytes().size()), body.bytes()));
+    }
+}
+
+ArrowFile::~ArrowFile() {
+    try {
+        close();
+    } catch (const std::exception &e) {
+        std::cerr << "WARNING: failed to finalise Arrow output: " << e.what() << '\n';
+    }
+}
+
+void
+ArrowFile::add(ArrowBatch &batch, std::size_t index, const immulator::Recombination &record) const {
+    batch.sequence_id.push_back(static_cast<int64_t>(index));
+    batch.calls[0].push_back(static_cast<int32_t>(vgermlines_.id(*record.v)));
+    batch.calls[1].push_back(static_cast<int32_t>(dgermlines_.id(*record.d)));
+    batch.calls[2].push_back(static_cast<int32_t>(jgermlines_.id(*record.j)));
+    // same order as POSITION_COLUMNS; D as emitted, like the AIRR output
+    const std::size_t values[] = {
+            record.cdr3_start, record.cdr3_end, record.size(), record.v_length, record.np1_length,
+            record.emitted_d_length(), record.np2_length(), record.j_length, record.v->size() - record.v_length,
+            record.d_5p_del, record.d_3p_del + (record.d_length - record.emitted_d_length()), record.j_start
+    };
+    for (std::size_t i = 0; i < ArrowBatch::NUM_POSITION_COLUMNS; ++i) {
+        batch.positions[i].push_back(static_cast<int32_t>(values[i]));
+    }
+}
+
+void
+ArrowFile::write(const ArrowBatch &batch) {
+    if (!batch.size()) {
+        return;
+    }
+    // everything but the file offset is independent of the other batches, so encode before taking the lock
+    Body body;
+    body.add_column(batch.sequence_id);
+    for (const auto &column : batch.calls) {
+        body.add_column(column);
+    }
+    for (const auto &column : batch.positions) {
+        body.add_column(column);
+    }
+    FlatBuilder fb;
+    auto record_batch = body.record_batch(fb, batch.size());
+    auto metadata = message(fb, HEADER_RECORD_BATCH, record_batch, body.bytes().size());
+    auto block = write_message(metadata, body.bytes());
+    std::lock_guard<std::mutex> lock(mutex_);
+    batches_.push_back(block);
+}
+
+ArrowFile::Block
+ArrowFile::write_message(const std::vector<uint8_t> &metadata, const std::vector<char> &body) {
+    // continuation marker and metadata size, then the metadata padded so that the body starts 8-byte aligned
+    std::vector<char> prefix(8 + (metadata.size() + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT, 0);
+    const auto padded_size = static_cast<uint32_t>(prefix.size() - 8);
+    for (std::size_t k = 0; k < 4; ++k) {
+        prefix[k] = static_cast<char>(CONTINUATION >> (8 * k));
+        prefix[4 + k] = static_cast<char>(padded_size >> (8 * k));
+    }
+    std::copy(metadata.begin(), metadata.end(), prefix.begin() + 8);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Block block{offset_, static_cast<int32_t>(prefix.size()), body.size()};
+    sink_.write(prefix.data(), prefix.size());
+    if (!body.empty()) {
+        sink_.write(body.data(), body.size());
+    }
+    offset_ += prefix.size() + body.size();
+    return block;
+}
+
+void
+ArrowFile::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    auto blocks = [](FlatBuilder &fb, const std::vector<Block> &blocks) {
+        std::vector<uint8_t> data;
+        for (const auto &block : blocks) {
+            put_le(data, block.offset, 8);
+            put_le(data, static_cast<uint32_t>(block.metadata_length), 4);
+            put_le(data, 0, 4);
+            put_le(data, block.body_length, 8);
+        }
+        return fb.structs(data, blocks.size());
+    };
+    FlatBuilder fb;
+    auto schema_offset = schema(fb);
+    auto dictionaries = blocks(fb, dictionaries_);
+    auto batches = blocks(fb, batches_);
+    fb.start_table();
+    fb.add<int16_t>(0, METADATA_V5);
+    fb.add_offset(1, schema_offset);
+    fb.add_offset(2, dictionaries);
+    fb.add_offset(3, batches);
+    auto footer = fb.finish(fb.end_table());
+
+    std::vector<char> tail;
+    // end of stream marker, footer, footer size and the closing magic
+    for (auto value : {CONTINUATION, 0u}) {
+        for (std::size_t k = 0; k < 4; ++k) {
+            tail.push_back(static_cast<char>(value >> (8 * k)));
+        }
+    }
+    tail.insert(tail.end(), footer.begin(), footer.end());
+    for (std::size_t k = 0; k < 4; ++k) {
+        tail.push_back(static_cast<char>(footer.size() >> (8 * k)));
+    }
+    tail.insert(tail.end(), MAGIC, MAGIC + sizeof(MAGIC) - 1);
+    sink_.write(tail.data(), tail.size());
+    sink_.close();
+}
+
+void
+ArrowBatchWriter::write(std::size_t index, const immulator::Recombination &record) {
+    file_.add(batch_, index, record);
+    if (batch_.size() >= batch_rows_) {
+        file_.write(batch_);
+        batch_.clear();
+    }
+}
+
+void
+ArrowBatchWriter::close() {
+    file_.write(batch_);
+    batch_.clear();
+}
+
+}   // namespace immulator
@@ -0,0 +1,107 @@
+//
+// @author: jiahong
+// @date  : 23/10/26 3:10 PM
+//
+
+#ifndef IMMULATOR_ARROW_IPC_H
+#define IMMULATOR_ARROW_IPC_H
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "germline_factory.h"
+#include "writer.h"
+
+namespace immulator {
+
+/// Columns of one Arrow record batch of the truth table: sequence ids, V/D/J calls as indices into the germline
+/// pools (their interned ids) and the int32 position/length columns, in ArrowFile::POSITION_COLUMNS order.
+struct ArrowBatch {
+    static constexpr std::size_t NUM_POSITION_COLUMNS = 12;
+
+    std::vector<int64_t> sequence_id;
+    std::array<std::vector<int32_t>, 3> calls;
+    std::array<std::vector<int32_t>, NUM_POSITION_COLUMNS> positions;
+
+    std::size_t size() const { return sequence_id.size(); }
+
+    void clear();
+};
+
+/// Truth table in the Arrow IPC file format (a.k.a. Feather v2), readable (and memory mappable without copying)
+/// by pyarrow, pandas, polars, R arrow etc. Gene calls are dictionary encoded against the germline pools, so the
+/// dictionaries are written once up front and every row only stores three int32 ids. Record batches can be
+/// written from several threads at once; they appear in the file in the order they are written.
+/// The metadata is encoded by hand (no dependency on the Arrow or FlatBuffers libraries); buffers are written in
+/// host byte order, which Arrow requires to be little endian here.
+class ArrowFile {
+public:
+    static const std::array<const char *, ArrowBatch::NUM_POSITION_COLUMNS> POSITION_COLUMNS;
+
+    /// \param filename file to create (or truncate)
+    /// \param vgermlines, dgermlines, jgermlines pools the recombinations are drawn from
+    ArrowFile(const std::string &filename, const immulator::GermlineFactory &vgermlines,
+              const immulator::GermlineFactory &dgermlines, const immulator::GermlineFactory &jgermlines);
+
+    ArrowFile(const ArrowFile &) = delete;
+
+    ArrowFile &operator=(const ArrowFile &) = delete;
+
+    ~ArrowFile();
+
+    /// appends record to batch
+    void add(ArrowBatch &batch, std::size_t index, const immulator::Recombination &record) const;
+
+    /// writes batch as one record batch; safe to call from any thread
+    void write(const ArrowBatch &batch);
+
+    /// writes the footer; further writes are not allowed
+    void close();
+
+private:
+    struct Block {
+        uint64_t offset;
+        int32_t metadata_length;
+        uint64_t body_length;
+    };
+
+    /// writes an encapsulated message (metadata plus the body buffers) and returns where it went
+    Block write_message(const std::vector<uint8_t> &metadata, const std::vector<char> &body);
+
+private:
+    const immulator::GermlineFactory &vgermlines_;
+    const immulator::GermlineFactory &dgermlines_;
+    const immulator::GermlineFactory &jgermlines_;
+
+    std::mutex mutex_;
+    FileSink sink_;
+    uint64_t offset_ = 0;
+    std::vector<Block> dictionaries_;
+    std::vector<Block> batches_;
+    bool closed_ = false;
+};
+
+/// Per thread writer of an ArrowFile: collects records into a batch of its own and writes it out whenever
+/// batch_rows records have been collected (and on close)
+class ArrowBatchWriter : public RecordWriter {
+public:
+    static constexpr std::size_t DEFAULT_BATCH_ROWS = 64 * 1024;
+
+    explicit ArrowBatchWriter(ArrowFile &file, std::size_t batch_rows = DEFAULT_BATCH_ROWS) :
+            file_(file), batch_rows_(batch_rows) {}
+
+    void write(std::size_t index, const immulator::Recombination &record) override;
+
+    void close() override;
+
+private:
+    ArrowFile &file_;
+    std::size_t batch_rows_;
+    ArrowBatch batch_;
+};
+
+}   // namespace immulator
+
+#endif //IMMULATOR_ARROW_IPC_H
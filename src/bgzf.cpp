@@ -0,0 +1,224 @@
+//
+// @author: jiahong
+// @date  : 20/10/26 10:37 AM
+//
+
+#include <zlib.h>
+#include <stdexcept>
+#include "bgzf.h"
+#include "trace.h"
+
+namespace immulator {
+
+namespace {
+
+// gzip member header with the BGZF "BC" extra subfield, the block size (minus 1) goes at offset 16
+constexpr unsigned char BGZF_HEADER[] = {
+        0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 'B', 'C', 0x02, 0x00, 0x00, 0x00
+};
+constexpr std::size_t BGZF_HEADER_SIZE = sizeof(BGZF_HEADER);
+// CRC32 + ISIZE
+constexpr std::size_t BGZF_FOOTER_SIZE = 8;
+constexpr std::size_t BGZF_MAX_BLOCK_SIZE = 0x10000;
+
+// empty BGZF block that marks the end of file
+constexpr unsigned char BGZF_EOF[] = {
+        0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 'B', 'C', 0x02, 0x00, 0x1b, 0x00,
+        0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+void
+put_le32(char *out, uint32_t value) {
+    out[0] = static_cast<char>(value & 0xff);
+    out[1] = static_cast<char>((value >> 8) & 0xff);
+    out[2] = static_cast<char>((value >> 16) & 0xff);
+    out[3] = static_cast<char>((value >> 24) & 0xff);
+}
+
+void
+put_le64(char *out, uint64_t value) {
+    put_le32(out, static_cast<uint32_t>(value & 0xffffffff));
+    put_le32(out + 4, static_cast<uint32_t>(value >> 32));
+}
+
+}   // namespace
+
+constexpr std::size_t BgzfSink::MAX_BLOCK_INPUT;
+
+BgzfSink::BgzfSink(std::unique_ptr<OutputSink> downstream, unsigned threads, int level) :
+        downstream_(std::move(downstream)), level_(level) {
+    if (!threads) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // keep every worker busy while the front job is being written, without buffering the whole output
+    max_in_flight_ = 2 * threads;
+    for (unsigned i = 0; i < threads; ++i) {
+        workers_.emplace_back(&BgzfSink::work, this);
+    }
+}
+
+BgzfSink::~BgzfSink() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+}
+
+void
+BgzfSink::write_index(const std::string &filename) {
+    index_filename_ = filename;
+}
+
+void
+BgzfSink::write(const char *data, std::size_t size) {
+    auto job = std::make_shared<Job>();
+    job->input.assign(data, data + size);
+    std::unique_lock<std::mutex> lock(mutex_);
+    jobs_.push_back(job);
+    pending_.push_back(job);
+    work_cv_.notify_one();
+    drain(lock, false);
+    while (jobs_.size() >= max_in_flight_) {
+        drain(lock, true);
+    }
+}
+
+void
+BgzfSink::close() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    while (!jobs_.empty()) {
+        drain(lock, true);
+    }
+    lock.unlock();
+    downstream_->write(reinterpret_cast<const char *>(BGZF_EOF), sizeof(BGZF_EOF));
+    downstream_->close();
+    if (!index_filename_.empty()) {
+        std::vector<char> gzi(8 + 16 * index_.size());
+        put_le64(gzi.data(), index_.size());
+        for (std::size_t i = 0; i < index_.size(); ++i) {
+            put_le64(&gzi[8 + 16 * i], index_[i].first);
+            put_le64(&gzi[16 + 16 * i], index_[i].second);
+        }
+        FileSink index(index_filename_);
+        index.write(gzi.data(), gzi.size());
+        index.close();
+    }
+}
+
+void
+BgzfSink::drain(std::unique_lock<std::mutex> &lock, bool wait) {
+    if (wait) {
+        done_cv_.wait(lock, [this] { return failure_ || jobs_.empty() || jobs_.front()->done; });
+    }
+    if (failure_) {
+        std::rethrow_exception(failure_);
+    }
+    while (!jobs_.empty() && jobs_.front()->done) {
+        auto job = jobs_.front();
+        jobs_.pop_front();
+        // only the producer thread drains, so order is kept even without holding the lock while writing
+        lock.unlock();
+        downstream_->write(job->output.data(), job->output.size());
+        if (!index_filename_.empty()) {
+            auto input_left = job->input.size();
+            for (auto block_size : job->block_sizes) {
+                // the first block implicitly starts at (0, 0)
+                if (compressed_offset_) {
+                    index_.emplace_back(compressed_offset_, uncompressed_offset_);
+                }
+                compressed_offset_ += block_size;
+                uncompressed_offset_ += std::min(MAX_BLOCK_INPUT, input_left);
+                input_left -= std::min(MAX_BLOCK_INPUT, input_left);
+            }
+        }
+        lock.lock();
+    }
+}
+
+void
+BgzfSink::work() {
+    z_stream stream{};
+    if (deflateInit2(&stream, level_, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fail(std::make_exception_ptr(std::runtime_error("failed to initialise zlib")));
+        return;
+    }
+    // an exception must not leave this thread (std::terminate), the producer rethrows it instead
+    try {
+        for (;;) {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                work_cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+                if (pending_.empty()) {
+                    break;
+                }
+                job = pending_.front();
+                pending_.pop_front();
+            }
+            compress(*job, &stream);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                job->done = true;
+            }
+            done_cv_.notify_all();
+        }
+    } catch (...) {
+        fail(std::current_exception());
+    }
+    deflateEnd(&stream);
+}
+
+void
+BgzfSink::fail(std::exception_ptr error) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!failure_) {
+            failure_ = error;
+        }
+    }
+    done_cv_.notify_all();
+}
+
+void
+BgzfSink::compress(Job &job, void *zstream) {
+    immulator::trace::Span span("compress");
+    auto &stream = *static_cast<z_stream *>(zstream);
+    const auto &input = job.input;
+    auto nblocks = (input.size() + MAX_BLOCK_INPUT - 1) / MAX_BLOCK_INPUT;
+    job.output.resize(nblocks * BGZF_MAX_BLOCK_SIZE);
+    std::size_t out = 0;
+    for (std::size_t in = 0; in < input.size(); in += MAX_BLOCK_INPUT) {
+        auto in_size = std::min(MAX_BLOCK_INPUT, input.size() - in);
+        char *block = &job.output[out];
+        std::copy(BGZF_HEADER, BGZF_HEADER + BGZF_HEADER_SIZE, block);
+
+        deflateReset(&stream);
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(&input[in]));
+        stream.avail_in = static_cast<uInt>(in_size);
+        stream.next_out = reinterpret_cast<Bytef *>(block + BGZF_HEADER_SIZE);
+        stream.avail_out = static_cast<uInt>(BGZF_MAX_BLOCK_SIZE - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE);
+        if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+            throw std::runtime_error("BGZF block does not fit in 64 KiB");
+        }
+        auto block_size = BGZF_HEADER_SIZE + stream.total_out + BGZF_FOOTER_SIZE;
+        block[16] = static_cast<char>((block_size - 1) & 0xff);
+        block[17] = static_cast<char>(((block_size - 1) >> 8) & 0xff);
+
+        auto crc = crc32(0L, reinterpret_cast<const Bytef *>(&input[in]), static_cast<uInt>(in_size));
+        put_le32(block + BGZF_HEADER_SIZE + stream.total_out, static_cast<uint32_t>(crc));
+        put_le32(block + BGZF_HEADER_SIZE + stream.total_out + 4, static_cast<uint32_t>(in_size));
+        out += block_size;
+        job.block_sizes.push_back(block_size);
+    }
+    job.output.resize(out);
+}
+
+}   // namespace immulator
@@ -0,0 +1,93 @@
+//
+// @author: jiahong
+// @date  : 20/10/26 10:37 AM
+//
+
+#ifndef IMMULATOR_BGZF_H
+#define IMMULATOR_BGZF_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "writer.h"
+
+namespace immulator {
+
+/// Compresses everything written to it into BGZF (blocked gzip, as used by samtools/htslib) before passing it on.
+/// Every BGZF block is a complete gzip member holding at most MAX_BLOCK_INPUT bytes, so the result is readable by
+/// plain gzip/zcat and can be seeked into block by block. Blocks are compressed on a pool of worker threads and
+/// written downstream strictly in the order they were handed to this sink.
+class BgzfSink : public OutputSink {
+public:
+    /// uncompressed bytes per BGZF block (same as htslib, leaves room for incompressible data within 64 KiB)
+    static constexpr std::size_t MAX_BLOCK_INPUT = 0xff00;
+
+    /// \param downstream where the compressed blocks go
+    /// \param threads number of compression workers, 0 uses std::thread::hardware_concurrency()
+    /// \param level zlib compression level
+    explicit BgzfSink(std::unique_ptr<OutputSink> downstream, unsigned threads = 0, int level = 6);
+
+    ~BgzfSink() override;
+
+    /// also writes the htslib .gzi index (compressed and uncompressed offset of every block) to filename on close,
+    /// which is what samtools needs next to a .fai to seek into the compressed file; call before the first write
+    void write_index(const std::string &filename);
+
+    void write(const char *data, std::size_t size) override;
+
+    /// waits for all pending blocks, writes them and appends the BGZF end-of-file marker
+    void close() override;
+
+private:
+    struct Job {
+        std::vector<char> input;
+        std::vector<char> output;
+        // compressed size of every BGZF block in output
+        std::vector<std::size_t> block_sizes;
+        bool done = false;
+    };
+
+    void work();
+
+    /// records the first failure of a worker and wakes the producer, which rethrows it from drain()
+    void fail(std::exception_ptr error);
+
+    /// writes finished jobs at the front of the queue; with wait, blocks until the front job is finished
+    /// \throw the failure of a worker, if there was one
+    void drain(std::unique_lock<std::mutex> &lock, bool wait);
+
+    void compress(Job &job, void *stream);
+
+private:
+    std::unique_ptr<OutputSink> downstream_;
+    int level_;
+    std::size_t max_in_flight_;
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    // every job in order of submission; the front is the next one to be written downstream
+    std::deque<std::shared_ptr<Job>> jobs_;
+    // jobs waiting to be picked up by a worker
+    std::deque<std::shared_ptr<Job>> pending_;
+    bool stopping_ = false;
+    bool closed_ = false;
+    std::exception_ptr failure_;
+
+    std::string index_filename_;
+    // (compressed, uncompressed) offset of every block after the first, as stored in a .gzi
+    std::vector<std::pair<uint64_t, uint64_t>> index_;
+    uint64_t compressed_offset_ = 0;
+    uint64_t uncompressed_offset_ = 0;
+};
+
+}   // namespace immulator
+
+#endif //IMMULATOR_BGZF_H
@@ -0,0 +1,133 @@
+//
+// @author: jiahong
+// @date  : 29/10/26 4:30 PM
+//
+
+#include <algorithm>
+#include <cstring>
+#include "checksum.h"
+
+namespace immulator {
+
+namespace {
+
+constexpr std::uint64_t PRIME1 = 11400714785074694791ULL;
+constexpr std::uint64_t PRIME2 = 14029467366897019727ULL;
+constexpr std::uint64_t PRIME3 = 1609587929392839161ULL;
+constexpr std::uint64_t PRIME4 = 9650029242287828579ULL;
+constexpr std::uint64_t PRIME5 = 2870177450012600261ULL;
+
+inline std::uint64_t
+rotl(std::uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// XXH64 is defined on little endian words, which is what every platform immulator runs on reads natively
+inline std::uint64_t
+read64(const unsigned char *p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint32_t
+read32(const unsigned char *p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint64_t
+stripe_round(std::uint64_t acc, std::uint64_t input) {
+    return rotl(acc + input * PRIME2, 31) * PRIME1;
+}
+
+inline std::uint64_t
+merge_round(std::uint64_t acc, std::uint64_t value) {
+    return (acc ^ stripe_round(0, value)) * PRIME1 + PRIME4;
+}
+
+/// consumes whole 32 byte stripes of data
+/// \return the bytes consumed
+std::size_t
+consume(std::uint64_t (&acc)[4], const unsigned char *data, std::size_t size) {
+    const unsigned char *p = data;
+    for (const unsigned char *end = data + size - size % 32; p < end; p += 32) {
+        acc[0] = stripe_round(acc[0], read64(p));
+        acc[1] = stripe_round(acc[1], read64(p + 8));
+        acc[2] = stripe_round(acc[2], read64(p + 16));
+        acc[3] = stripe_round(acc[3], read64(p + 24));
+    }
+    return static_cast<std::size_t>(p - data);
+}
+
+}   // namespace
+
+Xxh64::Xxh64() : acc_{PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1} {}
+
+void
+Xxh64::update(const char *data, std::size_t size) {
+    auto bytes = reinterpret_cast<const unsigned char *>(data);
+    total_ += size;
+    if (pending_size_) {
+        const std::size_t fill = std::min(size, sizeof(pending_) - pending_size_);
+        std::memcpy(pending_ + pending_size_, bytes, fill);
+        pending_size_ += fill;
+        bytes += fill;
+        size -= fill;
+        if (pending_size_ < sizeof(pending_)) {
+            return;
+        }
+        consume(acc_, pending_, sizeof(pending_));
+        pending_size_ = 0;
+    }
+    const auto consumed = consume(acc_, bytes, size);
+    pending_size_ = size - consumed;
+    std::memcpy(pending_, bytes + consumed, pending_size_);
+}
+
+std::uint64_t
+Xxh64::digest() const {
+    std::uint64_t h;
+    if (total_ >= 32) {
+        h = rotl(acc_[0], 1) + rotl(acc_[1], 7) + rotl(acc_[2], 12) + rotl(acc_[3], 18);
+        for (auto acc : acc_) {
+            h = merge_round(h, acc);
+        }
+    } else {
+        h = PRIME5;
+    }
+    h += total_;
+
+    const unsigned char *p = pending_;
+    const unsigned char *end = pending_ + pending_size_;
+    for (; p + 8 <= end; p += 8) {
+        h = rotl(h ^ stripe_round(0, read64(p)), 27) * PRIME1 + PRIME4;
+    }
+    if (p + 4 <= end) {
+        h = rotl(h ^ (read32(p) * PRIME1), 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h = rotl(h ^ (*p * PRIME5), 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+std::string
+Xxh64::hex(std::uint64_t digest) {
+    static const char DIGITS[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; --i, digest >>= 4) {
+        hex[i] = DIGITS[digest & 0xf];
+    }
+    return hex;
+}
+
+}   // namespace immulator
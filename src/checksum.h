@@ -0,0 +1,49 @@
+//
+// @author: jiahong
+// @date  : 29/10/26 4:30 PM
+//
+
+#ifndef IMMULATOR_CHECKSUM_H
+#define IMMULATOR_CHECKSUM_H
+
+#include <cstdint>
+#include <string>
+#include "writer.h"
+
+namespace immulator {
+
+/// Streaming XXH64 (seed 0): the digest of a stream fed in any number of pieces equals that of xxh64sum on the
+/// whole of it
+class Xxh64 {
+public:
+    Xxh64();
+
+    void update(const char *data, std::size_t size);
+
+    std::uint64_t digest() const;
+
+    /// the 16 lower case hex digits xxh64sum prints
+    static std::string hex(std::uint64_t digest);
+
+private:
+    std::uint64_t acc_[4];
+    std::uint64_t total_ = 0;
+    // tail of the input that does not fill a 32 byte stripe yet
+    unsigned char pending_[32];
+    std::size_t pending_size_ = 0;
+};
+
+/// Hashes the blocks instead of writing them anywhere (--checksum)
+class ChecksumSink : public OutputSink {
+public:
+    void write(const char *data, std::size_t size) override { hash_.update(data, size); }
+
+    std::uint64_t digest() const { return hash_.digest(); }
+
+private:
+    Xxh64 hash_;
+};
+
+}   // namespace immulator
+
+#endif //IMMULATOR_CHECKSUM_H
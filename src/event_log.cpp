@@ -0,0 +1,302 @@
+//
+// @author: jiahong
+// @date  : 24/10/26 10:05 AM
+//
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+#include "event_log.h"
+
+namespace immulator {
+
+namespace {
+
+void
+put_varint(std::vector<char> &out, unsigned long long value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/// reads a varint at p, throwing if it runs past end
+unsigned long long
+get_varint(const unsigned char *&p, const unsigned char *end) {
+    unsigned long long value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (p == end) {
+            throw std::runtime_error("truncated event log");
+        }
+        auto byte = *p++;
+        value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    throw std::runtime_error("corrupt event log");
+}
+
+int
+nt_code(char nt) {
+    switch (nt) {
+        case 'A':
+            return 0;
+        case 'C':
+            return 1;
+        case 'G':
+            return 2;
+        case 'T':
+            return 3;
+        default:
+            return -1;
+    }
+}
+
+constexpr char NUCLEOTIDES[] = "ACGT";
+
+}   // namespace
+
+constexpr const char EventLogWriter::MAGIC[];
+
+EventLogWriter::EventLogWriter(BufferedWriter &out, unsigned seed, const immulator::GermlineFactory &vgermlines,
+                               const immulator::GermlineFactory &dgermlines,
+                               const immulator::GermlineFactory &jgermlines) :
+        out_(out), vgermlines_(vgermlines), dgermlines_(dgermlines), jgermlines_(jgermlines) {
+    std::vector<char> header(MAGIC, MAGIC + sizeof(MAGIC));
+    put_varint(header, seed);
+    for (auto pool : {&vgermlines_, &dgermlines_, &jgermlines_}) {
+        put_varint(header, pool->germlines().size());
+        for (const auto &germ : pool->germlines()) {
+            put_varint(header, germ.name().size());
+            header.insert(header.end(), germ.name().begin(), germ.name().end());
+            put_varint(header, germ.size());
+        }
+    }
+    out_.write(header.data(), header.size());
+}
+
+void
+EventLogWriter::write(std::size_t index, const immulator::Recombination &record) {
+    if (frame_records_ == FRAME_RECORDS || (frame_records_ && index != frame_first_ + frame_records_)) {
+        flush_frame();
+    }
+    if (!frame_records_) {
+        frame_first_ = index;
+    }
+    ++frame_records_;
+
+    const auto d_end = std::min<std::size_t>(record.np1_length + record.d_length, record.junction.size());
+    const auto np2_length = record.np2_length();
+    // the P/N nucleotides are the junction minus the D slice (which the expander copies from the germline)
+    unsigned flags = 0;
+    for (std::size_t k = 0; k < record.junction.size(); ++k) {
+        if ((k < record.np1_length || k >= d_end) && nt_code(record.junction[k]) < 0) {
+            flags |= RAW_NUCLEOTIDES;
+        }
+    }
+    for (unsigned long long value : {
+            vgermlines_.id(*record.v), dgermlines_.id(*record.d), jgermlines_.id(*record.j),
+            static_cast<std::size_t>(record.v_length), static_cast<std::size_t>(record.d_5p_del),
+            static_cast<std::size_t>(record.d_length), static_cast<std::size_t>(record.j_start),
+            static_cast<std::size_t>(record.j_length), static_cast<std::size_t>(record.cdr3_start),
+            static_cast<std::size_t>(record.cdr3_end), static_cast<std::size_t>(record.np1_length),
+            static_cast<std::size_t>(np2_length), record.junction.size(), static_cast<std::size_t>(flags)}) {
+        put_varint(frame_, value);
+    }
+    const auto np1_length = std::min<std::size_t>(record.np1_length, record.junction.size());
+    auto nts = [&](std::size_t k) { return k < np1_length ? record.junction[k] : record.junction[d_end + k - np1_length]; };
+    const auto total = np1_length + np2_length;
+    if (flags & RAW_NUCLEOTIDES) {
+        for (std::size_t k = 0; k < total; ++k) {
+            frame_.push_back(nts(k));
+        }
+    } else {
+        for (std::size_t k = 0; k < total; k += 4) {
+            unsigned packed = 0;
+            for (std::size_t b = 0; b < 4 && k + b < total; ++b) {
+                packed |= static_cast<unsigned>(nt_code(nts(k + b))) << (2 * b);
+            }
+            frame_.push_back(static_cast<char>(packed));
+        }
+    }
+}
+
+void
+EventLogWriter::flush_frame() {
+    std::vector<char> header;
+    put_varint(header, frame_first_);
+    put_varint(header, frame_records_);
+    put_varint(header, frame_.size());
+    out_.write(header.data(), header.size());
+    out_.write(frame_.data(), frame_.size());
+    frame_.clear();
+    frame_records_ = 0;
+}
+
+void
+EventLogWriter::close() {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    if (frame_records_) {
+        flush_frame();
+    }
+    // end marker: an empty frame
+    flush_frame();
+}
+
+EventLog::EventLog(const std::string &filename, const immulator::GermlineFactory &vgermlines,
+                   const immulator::GermlineFactory &dgermlines, const immulator::GermlineFactory &jgermlines) :
+        filename_(filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "cannot open " + filename);
+    }
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        throw std::runtime_error(filename + " is not an event log");
+    }
+    map_size_ = static_cast<std::size_t>(st.st_size);
+    void *map = ::mmap(nullptr, map_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        throw std::system_error(errno, std::generic_category(), "cannot map " + filename);
+    }
+    map_ = static_cast<unsigned char *>(map);
+
+    const unsigned char *p = map_;
+    const unsigned char *end = map_ + map_size_;
+    const auto &magic = EventLogWriter::MAGIC;
+    if (map_size_ < sizeof(magic) || !std::equal(magic, magic + sizeof(magic), reinterpret_cast<const char *>(p))) {
+        ::munmap(map_, map_size_);
+        throw std::runtime_error(filename + " is not an event log");
+    }
+    p += sizeof(magic);
+    try {
+        seed_ = static_cast<unsigned>(get_varint(p, end));
+        const immulator::GermlineFactory *pools[] = {&vgermlines, &dgermlines, &jgermlines};
+        for (int segment = 0; segment < 3; ++segment) {
+            std::unordered_map<std::string, const immulator::Germline *> by_name;
+            for (const auto &germ : pools[segment]->germlines()) {
+                by_name.emplace(germ.name(), &germ);
+            }
+            auto count = get_varint(p, end);
+            for (unsigned long long i = 0; i < count; ++i) {
+                auto name_size = get_varint(p, end);
+                if (static_cast<std::size_t>(end - p) < name_size) {
+                    throw std::runtime_error("truncated event log");
+                }
+                std::string name(reinterpret_cast<const char *>(p), name_size);
+                p += name_size;
+                auto size = get_varint(p, end);
+                auto found = by_name.find(name);
+                // unknown germlines only matter if a record refers to them
+                germlines_[segment].push_back(found != by_name.end() && found->second->size() == size ?
+                                              found->second : nullptr);
+            }
+        }
+        for (;;) {
+            Frame frame{};
+            frame.first_index = get_varint(p, end);
+            frame.records = get_varint(p, end);
+            frame.size = get_varint(p, end);
+            if (!frame.records) {
+                break;
+            }
+            if (static_cast<std::size_t>(end - p) < frame.size) {
+                throw std::runtime_error("truncated event log");
+            }
+            frame.data = p;
+            p += frame.size;
+            frames_.push_back(frame);
+        }
+    } catch (const std::runtime_error &e) {
+        ::munmap(map_, map_size_);
+        throw std::runtime_error(filename + ": " + e.what());
+    }
+}
+
+EventLog::~EventLog() {
+    ::munmap(map_, map_size_);
+}
+
+std::size_t
+EventLog::size() const {
+    std::size_t records = 0;
+    for (const auto &frame : frames_) {
+        records += frame.records;
+    }
+    return records;
+}
+
+void
+EventLog::decode(const Frame &frame, std::vector<immulator::Recombination> &records) const {
+    records.resize(frame.records);
+    const unsigned char *p = frame.data;
+    const unsigned char *end = frame.data + frame.size;
+    for (auto &record : records) {
+        const immulator::Germline *segments[3];
+        for (int segment = 0; segment < 3; ++segment) {
+            auto id = get_varint(p, end);
+            if (id >= germlines_[segment].size() || !germlines_[segment][id]) {
+                throw std::runtime_error(filename_ + ": refers to a germline that is not (or differently) loaded");
+            }
+            segments[segment] = germlines_[segment][id];
+        }
+        record.v = segments[0];
+        record.d = segments[1];
+        record.j = segments[2];
+        record.v_length = get_varint(p, end);
+        record.d_5p_del = get_varint(p, end);
+        record.d_length = get_varint(p, end);
+        record.j_start = get_varint(p, end);
+        record.j_length = get_varint(p, end);
+        record.cdr3_start = get_varint(p, end);
+        record.cdr3_end = get_varint(p, end);
+        record.np1_length = get_varint(p, end);
+        const auto np2_length = get_varint(p, end);
+        const auto junction_size = get_varint(p, end);
+        const auto flags = get_varint(p, end);
+        // the writers index the germlines with these lengths, so a corrupt record must not get past here
+        if (record.v_length > record.v->size() || record.d_5p_del > record.d->size() ||
+            record.d_length > record.d->size() - record.d_5p_del || record.j_start > record.j->size() ||
+            record.j_length > record.j->size() - record.j_start || np2_length > junction_size) {
+            throw std::runtime_error(filename_ + ": corrupt event log (a record does not fit its germlines)");
+        }
+        record.d_3p_del = record.d->size() - record.d_5p_del - record.d_length;
+
+        // P1 N1 P2, D, P3 N2 P4, then cut back to the recorded length (see vdj_recombination)
+        const auto np1_length = std::min<std::size_t>(record.np1_length, junction_size);
+        const auto total = np1_length + np2_length;
+        const auto packed_size = flags & EventLogWriter::RAW_NUCLEOTIDES ? total : (total + 3) / 4;
+        if (static_cast<std::size_t>(end - p) < packed_size) {
+            throw std::runtime_error(filename_ + ": truncated event log");
+        }
+        auto nt = [&](std::size_t k) {
+            return flags & EventLogWriter::RAW_NUCLEOTIDES ? static_cast<char>(p[k]) :
+                   NUCLEOTIDES[(p[k / 4] >> (2 * (k % 4))) & 3];
+        };
+        auto &junction = record.junction;
+        junction.clear();
+        for (std::size_t k = 0; k < np1_length; ++k) {
+            junction += nt(k);
+        }
+        junction.append(record.d->sequence(), record.d_5p_del, record.d_length);
+        junction.resize(std::min<std::size_t>(junction.size(), junction_size - np2_length));
+        for (std::size_t k = np1_length; k < total; ++k) {
+            junction += nt(k);
+        }
+        p += packed_size;
+    }
+}
+
+}   // namespace immulator
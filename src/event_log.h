@@ -0,0 +1,102 @@
+//
+// @author: jiahong
+// @date  : 24/10/26 10:05 AM
+//
+
+#ifndef IMMULATOR_EVENT_LOG_H
+#define IMMULATOR_EVENT_LOG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "germline_factory.h"
+#include "writer.h"
+
+namespace immulator {
+
+/// Compact binary log of the recombination events, from which FASTA, reference and AIRR output can be rebuilt
+/// (EventLog) at a fraction of their size. Layout (all integers are LEB128 varints unless noted otherwise):
+///     header: MAGIC, seed, then for V, D and J: germline count, followed by name length + name of each germline
+///     frames: first index, record count, payload size in bytes, then the payload
+///     end:    a frame with a record count of 0
+/// Every record of a frame (its index being first index + position in the frame) is stored as:
+///     V, D, J ids (their position in the header), V length, D 5' trim, D length, J start, J length, CDR3 start,
+///     CDR3 end, P1N1P2 length, P3N2P4 length, junction length, flags, then the P/N nucleotides packed 2 bits
+///     each (A, C, G, T = 0..3), or as raw bytes if they contain anything else (flags & RAW_NUCLEOTIDES)
+/// Frames let a reader find record boundaries without decoding and expand them in parallel.
+class EventLogWriter : public RecordWriter {
+public:
+    static constexpr const char MAGIC[] = "IMMLOG1";
+    static constexpr std::size_t FRAME_RECORDS = 4096;
+    static constexpr unsigned RAW_NUCLEOTIDES = 1;
+
+    /// \param out buffered output stream
+    /// \param seed seed of the simulation, kept for reference
+    /// \param vgermlines, dgermlines, jgermlines pools the recombinations are drawn from
+    EventLogWriter(BufferedWriter &out, unsigned seed, const immulator::GermlineFactory &vgermlines,
+                   const immulator::GermlineFactory &dgermlines, const immulator::GermlineFactory &jgermlines);
+
+    void write(std::size_t index, const immulator::Recombination &record) override;
+
+    /// writes the pending frame and the end marker
+    void close() override;
+
+private:
+    void flush_frame();
+
+private:
+    BufferedWriter &out_;
+    const immulator::GermlineFactory &vgermlines_;
+    const immulator::GermlineFactory &dgermlines_;
+    const immulator::GermlineFactory &jgermlines_;
+    std::vector<char> frame_;
+    std::size_t frame_first_ = 0;
+    std::size_t frame_records_ = 0;
+    bool closed_ = false;
+};
+
+/// Read side of the event log; the file is memory mapped and only the frame headers are read up front
+class EventLog {
+public:
+    struct Frame {
+        std::size_t first_index;
+        std::size_t records;
+        const unsigned char *data;
+        std::size_t size;
+    };
+
+    /// \param filename log written by EventLogWriter
+    /// \param vgermlines, dgermlines, jgermlines pools to resolve the germline names of the log against; they
+    /// must contain every germline the log refers to (with the same sequence) and outlive the log
+    EventLog(const std::string &filename, const immulator::GermlineFactory &vgermlines,
+             const immulator::GermlineFactory &dgermlines, const immulator::GermlineFactory &jgermlines);
+
+    EventLog(const EventLog &) = delete;
+
+    EventLog &operator=(const EventLog &) = delete;
+
+    ~EventLog();
+
+    unsigned seed() const { return seed_; }
+
+    const std::vector<Frame> &frames() const { return frames_; }
+
+    /// total number of records
+    std::size_t size() const;
+
+    /// decodes frame into records (replacing its contents); safe to call from several threads at once
+    void decode(const Frame &frame, std::vector<immulator::Recombination> &records) const;
+
+private:
+    std::string filename_;
+    unsigned char *map_ = nullptr;
+    std::size_t map_size_ = 0;
+    unsigned seed_ = 0;
+    // germline of every id, per segment
+    std::vector<const immulator::Germline *> germlines_[3];
+    std::vector<Frame> frames_;
+};
+
+}   // namespace immulator
+
+#endif //IMMULATOR_EVENT_LOG_H
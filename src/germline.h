@@ -87,10 +87,14 @@ public:
         }
     }
 
-    const std::string name() const {
+    const std::string &name() const {
         return name_;
     }
 
+    const std::string &sequence() const {
+        return seq_;
+    }
+
     /// Returns a sub-sequence after cutting at start, ending at ncount bases later (i.e. exactly the same as
     /// regular std::string::substr)
     /// \param start start index to perform substr
@@ -23,12 +23,16 @@ public:
         parse_file(percentage);
     }
 
+    /// configured germlines, families or genes keyed by 1 - abundance; empty without a configuration file
+    const std::multimap<double, std::string> &distribution() const { return germline_distribution_; }
+
     template<typename T>
     std::string next_roll(T &generator) const {
         if (filename_.empty()) {
             return "";
         } else {
-            auto rand_d = dist_(generator);
+            std::uniform_real_distribution<double> dist(0, 1);
+            auto rand_d = dist(generator);
             return nearest_key(rand_d, generator);
         }
     }
@@ -39,9 +43,8 @@ private:
     template<typename T>
     std::string nearest_key(double roll, T &generator) const;
 private:
-    const std::string filename_;
+    std::string filename_;
     std::multimap<double, std::string> germline_distribution_;
-    mutable std::uniform_real_distribution<double> dist_{0, 1};
 };
 
 std::ostream &operator<<(std::ostream &os, const immulator::GermlineConfiguration &gcfg);
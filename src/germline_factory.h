@@ -10,6 +10,9 @@
 #include <vector>
 #include "germline.h"
 #include "germline_configuration.h"
+#include "probes.h"
+#include "stats.h"
+#include "trace.h"
 
 namespace immulator {
 
@@ -26,15 +29,33 @@ public:
         parse_file(allow_stop);
     }
 
+    /// the germlines of pool (without parsing its file again), drawn according to gcfg instead
+    GermlineFactory(const GermlineFactory &pool, const immulator::GermlineConfiguration &gcfg) :
+            filename_(pool.filename_), gcfg_(gcfg), germline_collection_(pool.germline_collection_) {}
 
+    /// draws a germline from the pool; the returned reference stays valid for the lifetime of this factory
     template<typename T>
-    immulator::Germline operator()(T &) const;
+    const immulator::Germline &operator()(T &) const;
+
+    /// the abundances operator() draws by (empty for uniform draws)
+    const immulator::GermlineConfiguration &configuration() const { return gcfg_; }
+
+    /// every germline parsed from the file (i.e. the pool operator() draws from)
+    const std::vector<immulator::Germline> &germlines() const { return germline_collection_; }
+
+    /// position of germ (which must come from this factory) in germlines(), i.e. its interned id
+    std::size_t id(const immulator::Germline &germ) const {
+        return static_cast<std::size_t>(&germ - germline_collection_.data());
+    }
 
 private:
     void parse_file(bool allow_stop);
 
     template<typename T>
-    immulator::Germline random_germline(T &) const;
+    const immulator::Germline &draw(T &) const;
+
+    template<typename T>
+    const immulator::Germline &random_germline(T &) const;
 
 private:
     const std::string filename_;
@@ -44,33 +65,44 @@ private:
 
 
 template<typename T>
-Germline
+const Germline &
 immulator::GermlineFactory::operator()(T &rand) const {
+    stats::StageTimer timer(stats::DRAW_GERMLINE);
+    trace::Span span("draw germline");
+    const auto &germ = draw(rand);
+    IMMULATOR_PROBE2(germline_drawn, id(germ), germ.name().c_str());
+    return germ;
+}
+
+template<typename T>
+const immulator::Germline &
+immulator::GermlineFactory::draw(T &rand) const {
     auto query = gcfg_.next_roll(rand);
     if (!query.empty()) {
-        std::vector<Germline> filtered_germlines;
-        std::copy_if(germline_collection_.begin(),
-                     germline_collection_.end(),
-                     std::back_inserter(filtered_germlines),
-                     [&query](const Germline &key) {
-                         if (query.find('*') != std::string::npos) {
-                             // user provided full (family-gene*allele)
-                             return key.name() == query;
-                         } else if (query.find('-') != std::string::npos) {
-                             // user provided gene (family-gene)
-                             return key.gene_name() == query;
-                         } else {
-                             // user provided family
-                             return key.family_name() == query;
-                         }
-                     });
+        std::vector<const Germline *> filtered_germlines;
+        for (const auto &key : germline_collection_) {
+            bool match;
+            if (query.find('*') != std::string::npos) {
+                // user provided full (family-gene*allele)
+                match = key.name() == query;
+            } else if (query.find('-') != std::string::npos) {
+                // user provided gene (family-gene)
+                match = key.gene_name() == query;
+            } else {
+                // user provided family
+                match = key.family_name() == query;
+            }
+            if (match) {
+                filtered_germlines.push_back(&key);
+            }
+        }
         if (filtered_germlines.empty()) {
             return random_germline(rand);
         } else {
             std::uniform_int_distribution<
-                    std::vector<Germline>::size_type> dist(0, filtered_germlines.size() - 1);
-            std::vector<Germline>::size_type index = dist(rand);
-            return filtered_germlines[index];
+                    std::vector<const Germline *>::size_type> dist(0, filtered_germlines.size() - 1);
+            std::vector<const Germline *>::size_type index = dist(rand);
+            return *filtered_germlines[index];
         }
     } else {
         return random_germline(rand);
@@ -78,7 +110,7 @@ immulator::GermlineFactory::operator()(T &rand) const {
 }
 
 template<typename T>
-immulator::Germline
+const immulator::Germline &
 immulator::GermlineFactory::random_germline(T &rand) const {
     std::uniform_int_distribution<
             std::vector<Germline>::size_type> dist(0, germline_collection_.size() - 1);
@@ -0,0 +1,103 @@
+//
+// @author: jiahong
+// @date  : 25/10/26 2:40 PM
+//
+// C interface of libimmulator, for calling the simulator in process through FFI. The caller owns every buffer
+// the records are written to: a generate call fills a caller provided arena with fixed size record descriptors
+// plus the packed nucleotide sequences they point into, and allocates nothing of its own (apart from the scratch
+// space of the simulator, which is reused between calls).
+//
+
+#ifndef IMMULATOR_IMMULATOR_H
+#define IMMULATOR_IMMULATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMMULATOR_ABI_VERSION 1
+
+typedef struct immulator_simulator immulator_simulator;
+
+enum immulator_segment {
+    IMMULATOR_V = 0,
+    IMMULATOR_D = 1,
+    IMMULATOR_J = 2
+};
+
+/// One generated record. Its sequence is arena->sequences[sequence_offset, sequence_offset + sequence_length),
+/// laid out as V (v_length) + P1 N1 P2 (np1_length) + D (d_length) + P3 N2 P4 (np2_length) + J (j_length).
+/// Germline ids index immulator_germline_name().
+typedef struct immulator_record {
+    uint64_t index;
+    uint64_t sequence_offset;
+    uint32_t sequence_length;
+    uint32_t v_id;
+    uint32_t d_id;
+    uint32_t j_id;
+    uint32_t v_length;
+    uint32_t np1_length;
+    uint32_t d_length;
+    uint32_t np2_length;
+    uint32_t j_length;
+    /// nucleotides trimmed off the 5' and 3' end of D and off the 5' end of J
+    uint32_t d_5p_del;
+    uint32_t d_3p_del;
+    uint32_t j_5p_del;
+    /// 1-indexed CDR3 boundaries, as in the reference file
+    uint32_t cdr3_start;
+    uint32_t cdr3_end;
+} immulator_record;
+
+/// Caller owned output space. The caller sets the pointers and capacities; immulator_generate sets the *_used
+/// fields. Sequences are packed back to back, without separators or terminators.
+typedef struct immulator_arena {
+    immulator_record *records;
+    size_t record_capacity;
+    char *sequences;
+    size_t sequence_capacity;
+    size_t records_used;
+    size_t sequences_used;
+} immulator_arena;
+
+/// \return IMMULATOR_ABI_VERSION of the library that is actually loaded
+int immulator_abi_version(void);
+
+/// Loads the germline database and (optionally) a germline distribution.
+/// \param vfile, dfile, jfile germline FASTA files
+/// \param config germline configuration file (see immulator -g), or NULL to draw germlines uniformly
+/// \param seed seed of the run; the records are the same as those of immulator -s seed
+/// \param error if not NULL, receives a NUL terminated message (truncated to error_size) on failure
+/// \return the simulator, or NULL on failure
+immulator_simulator *immulator_create(const char *vfile, const char *dfile, const char *jfile, const char *config,
+                                      uint32_t seed, char *error, size_t error_size);
+
+void immulator_destroy(immulator_simulator *simulator);
+
+/// Generates the next records of the run into arena, replacing whatever it held: min(n, arena->record_capacity,
+/// arena->sequence_capacity / immulator_max_sequence_length()) of them, so that they are guaranteed to fit.
+/// A simulator must not be used by several threads at once; create one per thread instead.
+/// \return the number of records generated (also in arena->records_used), or -1 on failure
+long long immulator_generate(immulator_simulator *simulator, size_t n, immulator_arena *arena);
+
+/// \return longest sequence a record can have; size arena->sequences for n records with n times this
+size_t immulator_max_sequence_length(const immulator_simulator *simulator);
+
+/// \return index of the record the next immulator_generate starts with
+uint64_t immulator_position(const immulator_simulator *simulator);
+
+/// \return number of germlines in the pool of segment
+size_t immulator_germline_count(const immulator_simulator *simulator, enum immulator_segment segment);
+
+/// \return NUL terminated name of germline id of segment (valid as long as the simulator), or NULL if out of range
+const char *immulator_germline_name(const immulator_simulator *simulator, enum immulator_segment segment,
+                                    size_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //IMMULATOR_IMMULATOR_H
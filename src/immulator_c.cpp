@@ -0,0 +1,169 @@
+//
+// @author: jiahong
+// @date  : 25/10/26 2:40 PM
+//
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include "immulator.h"
+#include "simulator.h"
+
+struct immulator_simulator {
+    std::unique_ptr<immulator::Simulator> simulator;
+};
+
+namespace {
+
+/// copies message into the caller's error buffer, truncating it if need be
+void
+set_error(char *error, std::size_t error_size, const char *message) {
+    if (error && error_size) {
+        auto size = std::min(std::strlen(message), error_size - 1);
+        std::memcpy(error, message, size);
+        error[size] = '\0';
+    }
+}
+
+/// Lays records out in the arena; the caller made sure they fit
+class ArenaWriter : public immulator::RecordWriter {
+public:
+    ArenaWriter(const immulator::Simulator &simulator, immulator_arena &arena) :
+            simulator_(simulator), arena_(arena) {}
+
+    void write(std::size_t index, const immulator::Recombination &record) override {
+        auto &out = arena_.records[arena_.records_used++];
+        out.index = index;
+        out.sequence_offset = arena_.sequences_used;
+        out.sequence_length = static_cast<uint32_t>(record.size());
+        out.v_id = static_cast<uint32_t>(simulator_.vgermlines().id(*record.v));
+        out.d_id = static_cast<uint32_t>(simulator_.dgermlines().id(*record.d));
+        out.j_id = static_cast<uint32_t>(simulator_.jgermlines().id(*record.j));
+        out.v_length = static_cast<uint32_t>(record.v_length);
+        out.np1_length = static_cast<uint32_t>(std::min(record.np1_length, record.junction.size()));
+        out.d_length = static_cast<uint32_t>(std::min(record.d_length, record.junction.size() - out.np1_length));
+        out.np2_length = static_cast<uint32_t>(record.np2_length());
+        out.j_length = static_cast<uint32_t>(record.j_length);
+        out.d_5p_del = static_cast<uint32_t>(record.d_5p_del);
+        out.d_3p_del = static_cast<uint32_t>(record.d_3p_del);
+        out.j_5p_del = static_cast<uint32_t>(record.j_start);
+        out.cdr3_start = static_cast<uint32_t>(record.cdr3_start);
+        out.cdr3_end = static_cast<uint32_t>(record.cdr3_end);
+
+        char *p = arena_.sequences + arena_.sequences_used;
+        std::memcpy(p, record.v_data(), record.v_length);
+        p += record.v_length;
+        std::memcpy(p, record.junction.data(), record.junction.size());
+        p += record.junction.size();
+        std::memcpy(p, record.j_data(), record.j_length);
+        arena_.sequences_used += record.size();
+    }
+
+private:
+    const immulator::Simulator &simulator_;
+    immulator_arena &arena_;
+};
+
+const immulator::GermlineFactory *
+pool(const immulator_simulator *simulator, immulator_segment segment) {
+    switch (segment) {
+        case IMMULATOR_V:
+            return &simulator->simulator->vgermlines();
+        case IMMULATOR_D:
+            return &simulator->simulator->dgermlines();
+        case IMMULATOR_J:
+            return &simulator->simulator->jgermlines();
+        default:
+            return nullptr;
+    }
+}
+
+}   // namespace
+
+extern "C" {
+
+int
+immulator_abi_version(void) {
+    return IMMULATOR_ABI_VERSION;
+}
+
+immulator_simulator *
+immulator_create(const char *vfile, const char *dfile, const char *jfile, const char *config, uint32_t seed,
+                 char *error, size_t error_size) {
+    if (!vfile || !dfile || !jfile) {
+        set_error(error, error_size, "germline files are required");
+        return nullptr;
+    }
+    try {
+        immulator::GermlineConfiguration gcfg;
+        if (config) {
+            gcfg = immulator::GermlineConfiguration(config, true);
+        }
+        std::unique_ptr<immulator_simulator> simulator(new immulator_simulator);
+        simulator->simulator.reset(new immulator::Simulator(vfile, dfile, jfile, gcfg, seed));
+        if (simulator->simulator->vgermlines().germlines().empty() ||
+            simulator->simulator->dgermlines().germlines().empty() ||
+            simulator->simulator->jgermlines().germlines().empty()) {
+            set_error(error, error_size, "no germlines could be read from the germline files");
+            return nullptr;
+        }
+        return simulator.release();
+    } catch (const std::exception &e) {
+        set_error(error, error_size, e.what());
+        return nullptr;
+    }
+}
+
+void
+immulator_destroy(immulator_simulator *simulator) {
+    delete simulator;
+}
+
+long long
+immulator_generate(immulator_simulator *simulator, size_t n, immulator_arena *arena) {
+    if (!simulator || !arena || (n && (!arena->records || !arena->sequences))) {
+        return -1;
+    }
+    arena->records_used = 0;
+    arena->sequences_used = 0;
+    auto count = std::min(n, arena->record_capacity);
+    count = std::min(count, arena->sequence_capacity / simulator->simulator->max_sequence_length());
+    if (!count) {
+        return 0;
+    }
+    try {
+        ArenaWriter writer(*simulator->simulator, *arena);
+        simulator->simulator->generate(count, writer);
+    } catch (const std::exception &) {
+        return -1;
+    }
+    return static_cast<long long>(arena->records_used);
+}
+
+size_t
+immulator_max_sequence_length(const immulator_simulator *simulator) {
+    return simulator->simulator->max_sequence_length();
+}
+
+uint64_t
+immulator_position(const immulator_simulator *simulator) {
+    return simulator->simulator->position();
+}
+
+size_t
+immulator_germline_count(const immulator_simulator *simulator, enum immulator_segment segment) {
+    auto factory = pool(simulator, segment);
+    return factory ? factory->germlines().size() : 0;
+}
+
+const char *
+immulator_germline_name(const immulator_simulator *simulator, enum immulator_segment segment, size_t id) {
+    auto factory = pool(simulator, segment);
+    if (!factory || id >= factory->germlines().size()) {
+        return nullptr;
+    }
+    return factory->germlines()[id].name().c_str();
+}
+
+}   // extern "C"
@@ -11,6 +11,13 @@
 #include <vector>
 #include <unordered_map>
 #include <cctype>
+#include <random>
+#include <limits>
+#include <tuple>
+#include <numeric>
+#include <algorithm>
+#include <iterator>
+#include <iostream>
 
 namespace immulator {
 inline std::string strip_string(const std::string &str, const std::string &delim);
@@ -19,6 +26,8 @@ inline std::vector<std::string> split_string(const std::string &str, const std::
 
 inline std::string translate(const std::string &ntseq);
 
+inline std::size_t translate_codons(const char *nt, std::size_t size, char *out);
+
 inline std::string &toupper(std::string &str);
 
 inline std::string toupper(const std::string &str);
@@ -31,10 +40,10 @@ local_align(const std::string &string1, const std::string &string2, double ins,
             std::unordered_map<char, std::unordered_map<char, double>> scoring_matrix);
 
 template<typename T>
-const T &max(const T &x, const T &x1);
+T max(const T &x, const T &x1);
 
 template<typename T, typename... Args>
-const T &max(const T &x, const T &x1, Args... xs);
+T max(const T &x, const T &x1, const Args &... xs);
 
 
 inline bool double_eq(double d1, double d2, double epsilon = 1e-5);
@@ -47,6 +56,8 @@ inline std::string allowed_nts(const std::string &rem);
 template<typename Gen>
 inline bool coin_flip(Gen &generator, double success_rate = 0.5);
 
+inline std::size_t format_uint(char *out, unsigned long long value);
+
 
 std::string
 strip_string(const std::string &str, const std::string &delim) {
@@ -121,6 +132,36 @@ coin_flip(Gen &generator, double success_rate) {
     return bernoulli_trial(generator);
 }
 
+/// writes the decimal representation of value into out (two digits at a time, no trailing '\0')
+/// \param out buffer with room for at least 20 characters
+/// \param value unsigned integer to format
+/// \return number of characters written
+std::size_t
+format_uint(char *out, unsigned long long value) {
+    static constexpr char DIGIT_PAIRS[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+    while (value >= 100) {
+        auto pair = static_cast<std::size_t>(value % 100) * 2;
+        value /= 100;
+        *--p = DIGIT_PAIRS[pair + 1];
+        *--p = DIGIT_PAIRS[pair];
+    }
+    if (value >= 10) {
+        auto pair = static_cast<std::size_t>(value) * 2;
+        *--p = DIGIT_PAIRS[pair + 1];
+        *--p = DIGIT_PAIRS[pair];
+    } else {
+        *--p = static_cast<char>('0' + value);
+    }
+    auto len = static_cast<std::size_t>(tmp + sizeof(tmp) - p);
+    std::copy(p, p + len, out);
+    return len;
+}
+
 std::string
 translate(const std::string &ntseq) {
     static constexpr char STOP_CODON = '*';
@@ -155,6 +196,45 @@ translate(const std::string &ntseq) {
     return aa;
 }
 
+/// Table driven scalar translation for bulk use: two table loads per codon, no allocations or hash lookups.
+/// Unlike translate(), codons with anything but ACGT (in either case) become 'X' instead of being dropped.
+/// \param nt nucleotides, translated from the first one on
+/// \param size number of nucleotides; a trailing partial codon is ignored
+/// \param out room for at least size / 3 amino acids
+/// \return number of amino acids written
+std::size_t
+translate_codons(const char *nt, std::size_t size, char *out) {
+    struct Tables {
+        // nucleotide -> 0..3 (A, C, G, T), anything else -> 4
+        unsigned char code[256];
+        // 25 * first + 5 * second + third -> amino acid
+        char amino_acid[125];
+    };
+    static const Tables tables = [] {
+        Tables t{};
+        std::fill(std::begin(t.code), std::end(t.code), 4);
+        const char bases[] = "ACGT";
+        for (unsigned char b = 0; b < 4; ++b) {
+            t.code[static_cast<unsigned char>(bases[b])] = b;
+            t.code[static_cast<unsigned char>(std::tolower(bases[b]))] = b;
+        }
+        std::fill(std::begin(t.amino_acid), std::end(t.amino_acid), 'X');
+        // standard genetic code in TCAG order
+        const char code[] = "FFLLSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG";
+        const unsigned char tcag[] = {3, 1, 0, 2};
+        for (int i = 0; i < 64; ++i) {
+            t.amino_acid[25 * tcag[i >> 4] + 5 * tcag[(i >> 2) & 3] + tcag[i & 3]] = code[i];
+        }
+        return t;
+    }();
+    const auto codons = size / 3;
+    const auto *p = reinterpret_cast<const unsigned char *>(nt);
+    for (std::size_t i = 0; i < codons; ++i, p += 3) {
+        out[i] = tables.amino_acid[25 * tables.code[p[0]] + 5 * tables.code[p[1]] + tables.code[p[2]]];
+    }
+    return codons;
+}
+
 template<typename T>
 class optional {
 public:
@@ -328,12 +408,13 @@ local_align(const std::string &string1, const std::string &string2, double ins,
 
 // yes.. we can use std::max({1,2,3,... }). whatever.
 template<typename T>
-const T &max(const T &x, const T &x1) {
+T max(const T &x, const T &x1) {
     return std::max(x, x1);
 }
 
+// returns by value: the intermediate std::max result would otherwise dangle once the recursive call returns
 template<typename T, typename... Args>
-const T &max(const T &x, const T &x1, Args... xs) {
+T max(const T &x, const T &x1, const Args &... xs) {
     return immulator::max(std::max(x, x1), xs...);
 };
 
@@ -0,0 +1,60 @@
+//
+// @author: jiahong
+// @date  : 22/10/26 2:45 PM
+//
+
+#include "index.h"
+#include "immutils.h"
+
+namespace immulator {
+
+void
+FaiWriter::write(std::size_t index, const immulator::Recombination &record) {
+    // the record name is everything between '>' and the newline: index|V,D,J
+    char digits[20];
+    auto index_size = immulator::format_uint(digits, index);
+    out_.write(digits, index_size);
+    out_.put('|');
+    out_.write(record.v->name());
+    out_.put(',');
+    out_.write(record.d->name());
+    out_.put(',');
+    out_.write(record.j->name());
+    const auto name_size = index_size + 1 + record.v->name().size() + record.d->name().size()
+                           + record.j->name().size() + 2;
+    const auto seq_size = record.size();
+    const auto seq_offset = offset_ + 1 + name_size + 1;
+    // same layout as FastaWriter: every line but the last is full and an empty sequence still gets its newline
+    const auto line_bases = line_width_ ? line_width_ : seq_size;
+    const auto lines = line_width_ ? std::max<std::size_t>((seq_size + line_width_ - 1) / line_width_, 1) : 1;
+
+    out_.put('\t');
+    out_.write_uint(seq_size);
+    out_.put('\t');
+    out_.write_uint(seq_offset);
+    out_.put('\t');
+    out_.write_uint(line_bases);
+    out_.put('\t');
+    out_.write_uint(line_bases + 1);
+    out_.put('\n');
+    offset_ = seq_offset + seq_size + lines;
+}
+
+constexpr const char ReferenceIndexWriter::MAGIC[];
+
+ReferenceIndexWriter::ReferenceIndexWriter(BufferedWriter &out, bool header_written) :
+        out_(out), offset_(header_written ? sizeof(ReferenceWriter::HEADER) - 1 : 0) {
+    out_.write(MAGIC, sizeof(MAGIC));
+}
+
+void
+ReferenceIndexWriter::write(std::size_t, const immulator::Recombination &record) {
+    char bytes[8];
+    for (int i = 0; i < 8; ++i) {
+        bytes[i] = static_cast<char>((offset_ >> (8 * i)) & 0xff);
+    }
+    out_.write(bytes, sizeof(bytes));
+    offset_ += ReferenceWriter::record_size(record);
+}
+
+}   // namespace immulator
@@ -0,0 +1,50 @@
+//
+// @author: jiahong
+// @date  : 22/10/26 2:45 PM
+//
+
+#ifndef IMMULATOR_INDEX_H
+#define IMMULATOR_INDEX_H
+
+#include "writer.h"
+
+namespace immulator {
+
+/// Writes the samtools faidx index (.fai) of the FASTA written by FastaWriter/GatherFastaWriter, so the output
+/// can be randomly accessed without scanning it again. Offsets follow from the record layout alone, so this
+/// works for any FASTA sink; it must see every record, in the same order as the FASTA writer.
+class FaiWriter : public RecordWriter {
+public:
+    /// \param out buffered index stream
+    /// \param line_width line width of the FASTA writer, 0 if sequences are not wrapped
+    explicit FaiWriter(BufferedWriter &out, std::size_t line_width = 0) : out_(out), line_width_(line_width) {}
+
+    void write(std::size_t index, const immulator::Recombination &record) override;
+
+private:
+    BufferedWriter &out_;
+    std::size_t line_width_;
+    // offset of the next record in the (uncompressed) FASTA
+    unsigned long long offset_ = 0;
+};
+
+/// Writes a binary index of the reference table: the MAGIC string, followed by the 64 bit little endian byte
+/// offset of every row (in the uncompressed file), so row i starts at offset 8 + 8 * i of the index.
+class ReferenceIndexWriter : public RecordWriter {
+public:
+    static constexpr const char MAGIC[] = "IMMIDX1";
+
+    /// \param out buffered index stream
+    /// \param header_written whether the table starts with ReferenceWriter::HEADER
+    explicit ReferenceIndexWriter(BufferedWriter &out, bool header_written = true);
+
+    void write(std::size_t index, const immulator::Recombination &record) override;
+
+private:
+    BufferedWriter &out_;
+    unsigned long long offset_;
+};
+
+}   // namespace immulator
+
+#endif //IMMULATOR_INDEX_H
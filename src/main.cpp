@@ -7,50 +7,72 @@
 #include <tuple>
 #include <regex>
 #include <fstream>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
 
 #include "cxxopts.hpp"
 #include "germline_factory.h"
+#include "recombination.h"
+#include "writer.h"
+#include "bgzf.h"
+#include "uring.h"
+#include "mapped_output.h"
+#include "splice.h"
+#include "index.h"
+#include "airr.h"
+#include "arrow_ipc.h"
+#include "event_log.h"
+#include "partition.h"
+#include "server.h"
+#include "simulator.h"
+#include "checksum.h"
+#include "perf.h"
+#include "progress.h"
+#include "stats.h"
+#include "trace.h"
 
 #define VERSION "Immulator v0.0.99"
 
 using std::string;
-using immulator::Germline;
 
-// Testing
-std::tuple<immulator::optional<Germline>, immulator::Germline::size_type, immulator::Germline::size_type>
-vdj_recombination(const Germline &vgerm, const Germline &dgerm, const Germline &jgerm, bool prod = true,
-                  bool multiple = true);
+using ThreadWriters = std::vector<std::unique_ptr<immulator::RecordWriter>>;
+using Batch = std::vector<immulator::Recombination>;
 
-template<typename Gen>
-immulator::optional<std::pair<Germline, immulator::Germline::size_type>> vcutter(Germline vgerm, Gen &generator);
-
-template<typename Gen>
-std::tuple<Germline, immulator::Germline::size_type, bool>
-dcutter(Germline dgerm, Gen &generator, const std::string &rem, bool check = true);
-
-template<typename Gen>
-immulator::optional<std::tuple<Germline, immulator::Germline::size_type, bool>>
-jcutter(Germline jgerm, Gen &generator, const std::string &rem,
-        std::string::size_type extras, bool check);
-
-template<typename Gen>
-immulator::optional<std::string>
-palindromic(std::string::size_type n, Gen &generator, const std::string &rem, bool productive = true);
-
-template<typename Gen>
-std::string
-random_nts(std::string::size_type n, Gen &generator, const std::string &rem, bool productive = true);
+void
+simulate(std::size_t seqs, const immulator::Simulator &simulator, unsigned threads,
+         const std::vector<immulator::RecordWriter *> &writers,
+         const std::function<ThreadWriters()> &make_thread_writers = nullptr);
 
 void
-write_reference(std::ofstream &os, const std::string &name,
-        immulator::Germline::size_type cdr3_start,
-        immulator::Germline::size_type cdr3_end);
+expand(const immulator::EventLog &log, unsigned threads, const std::vector<immulator::RecordWriter *> &writers,
+       const std::function<ThreadWriters()> &make_thread_writers = nullptr);
 
 int
 main(int argc, char *argv[]) {
     auto seed = std::random_device{}();
     std::string reference_filename("immulator.csv");
-    cxxopts::Options options(argv[0], "Immunoglobulin simulator - simulates V region antibody sequences.");
+    // "immulator expand LOG [options]" rebuilds the output of an event log instead of simulating
+    std::string log_to_expand;
+    // "immulator serve SOCKET [options]" answers generation requests on a Unix domain socket (see server.h)
+    std::string socket_path;
+    if (argc > 2 && (std::string(argv[1]) == "expand" || std::string(argv[1]) == "serve")) {
+        (std::string(argv[1]) == "expand" ? log_to_expand : socket_path) = argv[2];
+        argv[2] = argv[0];
+        argc -= 2;
+        argv += 2;
+    }
+    cxxopts::Options options(argv[0], "Immunoglobulin simulator - simulates V region antibody sequences.\n"
+                                      "Use 'expand LOG [options]' as the first arguments to rebuild the output of "
+                                      "an event log (see --log) instead, or 'serve SOCKET [options]' to keep the "
+                                      "germlines loaded and answer requests like 'n=1000 seed=7 config=germ.cfg "
+                                      "format=fasta|csv|airr' on a Unix domain socket, serving --threads "
+                                      "connections at once.");
     options.add_options()
             ("n,num", "number of sequences to simulate", cxxopts::value<std::size_t>())
             ("s,seed", "seed random generator; keep this between the range of"
@@ -61,6 +83,58 @@ main(int argc, char *argv[]) {
                             "distributions", cxxopts::value<std::string>())
             ("r,reference", "germline and CDR3 information will be saved in this file, defaults "
                             "to immulator.csv", cxxopts::value<std::string>())
+            ("w,width", "wrap FASTA sequence lines at this many characters; 0 (default) writes each sequence "
+                        "on a single line", cxxopts::value<std::size_t>())
+            ("gather", "write FASTA records with writev(2) straight from the germline pool instead of "
+                       "copying them into the output buffer (ignored when --width is given)")
+            ("z,bgzf", "compress FASTA and reference output as BGZF (blocked gzip); the reference file "
+                       "defaults to immulator.csv.gz")
+            ("uring", "write FASTA and reference files through io_uring with several blocks in flight; "
+                      "falls back to write(2) when io_uring is unavailable or stdout is not a regular file")
+            ("compress-threads", "number of BGZF compression threads, defaults to the number of cores",
+                    cxxopts::value<unsigned>())
+            ("o,output", "write FASTA to this file instead of stdout", cxxopts::value<std::string>())
+            ("t,threads", "number of generator threads, defaults to 1; output does not depend on it",
+                    cxxopts::value<unsigned>())
+            ("mmap", "let generator threads write straight into preallocated, memory mapped output and reference "
+                     "files (requires --output); records are written in completion order rather than by index, "
+                     "and --gather, --uring and --bgzf are ignored")
+            ("no-splice", "use plain write(2) instead of vmsplice(2) when stdout is a pipe")
+            ("airr", "also write the truth table as an AIRR rearrangement TSV (segment boundaries, trims, N/P "
+                     "lengths) to this file; compressed as well with --bgzf (ignored with --mmap)",
+                    cxxopts::value<std::string>())
+            ("arrow", "also write the truth table (dictionary encoded gene calls, int32 positions and lengths) to "
+                      "this Arrow IPC/Feather file; every generator thread writes its own record batches",
+                    cxxopts::value<std::string>())
+            ("p,protein", "also write the translated sequences as protein FASTA to this file; compressed as well "
+                          "with --bgzf (ignored with --mmap)", cxxopts::value<std::string>())
+            ("partition-by", "split FASTA and reference output into one <output>.<key>.fa/.csv pair per V family "
+                             "(vfamily), V gene (vgene), CDR3 amino acid length (cdr3) or per --chunk-size "
+                             "records (chunk); <output> defaults to immulator (ignored with --mmap)",
+                    cxxopts::value<std::string>())
+            ("chunk-size", "records per partition with --partition-by chunk, defaults to 1000000",
+                    cxxopts::value<std::size_t>())
+            ("log", "also write a compact binary log of the recombination events to this file; 'expand' "
+                    "rebuilds FASTA, reference, AIRR etc. from it", cxxopts::value<std::string>())
+            ("log-only", "only write the event log (and --arrow, if given)")
+            ("trace", "record what every thread does (batch generation, germline draws, junctions, formatting, "
+                      "flushes, compression) and write it as Chrome trace JSON to this file at exit",
+                    cxxopts::value<std::string>())
+            ("stats", "count the iterations and exhausted attempts of the retry loops, time every recombination "
+                      "stage, count its heap allocations and summarise the repeated warnings; reported on stderr "
+                      "at exit")
+            ("perf", "count cycles, instructions, cache misses and branch mispredicts (Linux perf_event_open) of "
+                     "V trimming, junction building, J anchoring and formatting on every thread; IPC and miss "
+                     "rates are reported on stderr at exit")
+            ("progress", "every this many seconds (--progress=SECONDS, 10 if not given), report the sequences done, "
+                         "the current and average rate and the ETA on stderr",
+                    cxxopts::value<double>()->implicit_value("10"))
+            ("checksum", "instead of writing the output, print the XXH64 digest of each stream (FASTA, reference, and "
+                         "--protein and --airr if given) to stdout; the digests equal xxh64sum of the uncompressed "
+                         "files, whatever the thread count")
+            ("index", "while writing, also write the samtools index of the FASTA output (<output>.fai, requires "
+                      "--output) and a binary row offset index of the reference file (<reference>.idx); with "
+                      "--bgzf the .gzi block indices are written as well (not with --mmap or --partition-by)")
             ;
     auto args = options.parse(argc, argv);
     if (args.count("help")) {
@@ -71,561 +145,511 @@ main(int argc, char *argv[]) {
         std::cout << VERSION << std::endl;
         return (EXIT_SUCCESS);
     }
-    if (!args.count("num")) {
+    const bool expanding = !log_to_expand.empty();
+    const bool serving = !socket_path.empty();
+    if (!args.count("num") && !expanding && !serving) {
         std::cout << options.help() << std::endl;
         return (EXIT_FAILURE);
     }
     if (args.count("seed")) {
         seed = args["seed"].as<unsigned int>();
     }
+    if (args.count("trace")) {
+        immulator::trace::enable(args["trace"].as<std::string>());
+    }
+    if (args.count("perf") && immulator::perf::enable()) {
+        std::atexit([] { immulator::perf::report(std::cerr); });
+    }
+    if (args.count("stats")) {
+        immulator::stats::enable();
+        std::atexit([] { immulator::stats::report(std::cerr); });
+    }
+    const bool bgzf = args.count("bgzf") > 0;
+    const bool mapped = args.count("mmap") > 0;
+    const bool partitioned = args.count("partition-by") > 0;
+    const bool indexed = args.count("index") > 0;
+    if (mapped && !args.count("output")) {
+        std::cerr << "--mmap needs an output file (-o)" << std::endl;
+        return (EXIT_FAILURE);
+    }
+    if (indexed && (mapped || partitioned)) {
+        std::cerr << "--index cannot be combined with " << (mapped ? "--mmap" : "--partition-by") << std::endl;
+        return (EXIT_FAILURE);
+    }
+    immulator::PartitionedWriter::Key partition_key{};
+    if (partitioned) {
+        try {
+            partition_key = immulator::PartitionedWriter::parse_key(args["partition-by"].as<std::string>());
+        } catch (const std::invalid_argument &e) {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            return (EXIT_FAILURE);
+        }
+    }
     if (args.count("reference")) {
-        reference_filename = args["referece"].as<std::string>();
+        reference_filename = args["reference"].as<std::string>();
+    } else if (bgzf && !mapped) {
+        reference_filename += ".gz";
     }
 
-    std::cerr << "This simulation run is generated with seed " << seed << std::endl;
-    std::mt19937 mersenne(seed);
-    std::ofstream refos(reference_filename);
+    std::size_t seqs = expanding || serving ? 0 : args["num"].as<std::size_t>();
+    const std::size_t line_width = args.count("width") ? args["width"].as<std::size_t>() : 0;
+    const unsigned threads = args.count("threads") ? std::max(1u, args["threads"].as<unsigned>()) : 1;
 
+    immulator::GermlineConfiguration gcfg;
     if (args.count("germlinecfg")) {
-        const std::size_t seqs = args["num"].as<std::size_t>();
-        immulator::GermlineConfiguration gcfg(args["germlinecfg"].as<std::string>(), true);
+        gcfg = immulator::GermlineConfiguration(args["germlinecfg"].as<std::string>(), true);
         const string title(80, '=');
         std::cerr << title << '\n'
                   << "\t\t\tConfiguration file found\n" << title << '\n'
                   << gcfg << std::endl;
-        immulator::GermlineFactory vgermlines("../imgt_human_ighv", gcfg, false);
-        immulator::GermlineFactory dgermlines("../imgt_human_ighd", gcfg, false);
-        immulator::GermlineFactory jgermlines("../imgt_human_ighj", gcfg, false);
-        for (auto i = 0; i < seqs; ++i) {
-            immulator::optional<Germline> recombined;
-            immulator::Germline::size_type cdr3_start, cdr3_end;
-            do {
-                std::tie(recombined, cdr3_start, cdr3_end)= vdj_recombination(vgermlines(mersenne), dgermlines(mersenne), jgermlines(mersenne));
-            } while (!recombined);
-            std::cout << ">" << i << *recombined << std::endl;
-            write_reference(refos, recombined->name(), cdr3_start, cdr3_end);
+    }
+    // when expanding, only the germline pools of the simulator are used (the log brings its own seed)
+    immulator::Simulator simulator("../imgt_human_ighv", "../imgt_human_ighd", "../imgt_human_ighj", gcfg, seed);
+    if (serving) {
+        immulator::Server server(socket_path, simulator, threads);
+        std::cerr << "Serving on " << socket_path << " with " << threads << " thread(s)" << std::endl;
+        server.run();
+        return (EXIT_FAILURE);
+    }
+    const auto &vgermlines = simulator.vgermlines();
+    const auto &dgermlines = simulator.dgermlines();
+    const auto &jgermlines = simulator.jgermlines();
+
+    std::unique_ptr<immulator::EventLog> log;
+    if (expanding) {
+        try {
+            log = std::make_unique<immulator::EventLog>(log_to_expand, vgermlines, dgermlines, jgermlines);
+        } catch (const std::runtime_error &e) {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            return (EXIT_FAILURE);
         }
-
+        seed = log->seed();
+        seqs = log->size();
+        std::cerr << "Expanding " << seqs << " sequences of the simulation run with seed " << seed << std::endl;
     } else {
-        const std::size_t seqs = args["num"].as<std::size_t>();
-        immulator::GermlineFactory vgermlines("../imgt_human_ighv", false);
-        immulator::GermlineFactory dgermlines("../imgt_human_ighd", false);
-        immulator::GermlineFactory jgermlines("../imgt_human_ighj", false);
-        for (auto i = 0; i < seqs; ++i) {
-            immulator::optional<Germline> recombined;
-            immulator::Germline::size_type cdr3_start, cdr3_end;
-            do {
-                std::tie(recombined, cdr3_start, cdr3_end)= vdj_recombination(vgermlines(mersenne), dgermlines(mersenne), jgermlines(mersenne));
-            } while (!recombined);
-            std::cout << ">" << i << *recombined << std::endl;
-            write_reference(refos, recombined->name(), cdr3_start, cdr3_end);
-        }
+        std::cerr << "This simulation run is generated with seed " << seed << std::endl;
     }
-    return (EXIT_SUCCESS);
-}
-
-
-// Testing
-std::tuple<immulator::optional<Germline>, immulator::Germline::size_type, immulator::Germline::size_type>
-vdj_recombination(const Germline &vgerm, const Germline &dgerm, const Germline &jgerm, bool prod, bool multiple) {
-    using size_type = immulator::Germline::size_type;
-    static std::mt19937 mersenne(std::random_device{}());
-    static constexpr std::size_t MAX_ATTEMPTS = 100'000;
-    auto v = vcutter(vgerm, mersenne);
-    std::size_t attempts_insertion = 0;
-    Germline buffer;
-    std::uniform_int_distribution<std::string::size_type> palin_rand(0, 8);
-    std::uniform_int_distribution<std::string::size_type> ins_rand(0, 5);
+    const double progress_interval = args.count("progress") ? args["progress"].as<double>() : 0;
+    auto run = [&](const std::vector<immulator::RecordWriter *> &writers,
+                   const std::function<ThreadWriters()> &make_thread_writers) {
+        if (progress_interval > 0) {
+            immulator::progress::start(seqs, progress_interval);
+        }
+        try {
+            if (log) {
+                expand(*log, threads, writers, make_thread_writers);
+            } else {
+                simulate(seqs, simulator, threads, writers, make_thread_writers);
+            }
+        } catch (const std::exception &e) {
+            // every thread has stopped by now (see run_batches), the output is incomplete
+            immulator::progress::stop();
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        immulator::progress::stop();
+    };
 
-    if (v) {
-        buffer = v->first;
-        bool d_prod = false;
-        Germline d;
-        size_type dsize;
-        // starts AFTER Cys (and convert to 1-index)
-        size_type cdr3_start_pos = v->second + 3 + 1;
-        std::size_t attempt_d = 0;
-        auto p1 = palindromic(palin_rand(mersenne), mersenne, buffer.remainder(), prod);
-        while (!p1 && prod && ++attempts_insertion < MAX_ATTEMPTS) {
-            p1 = palindromic(palin_rand(mersenne), mersenne, buffer.remainder(), prod);
+    if (args.count("checksum")) {
+        // hash in modest blocks, while the formatted records are still in cache
+        static constexpr std::size_t CHECKSUM_BLOCK_SIZE = 256 << 10;
+        std::vector<std::pair<const char *, const immulator::ChecksumSink *>> digests;
+        std::vector<std::unique_ptr<immulator::BufferedWriter>> outs;
+        auto stream = [&](const char *name) -> immulator::BufferedWriter & {
+            auto sink = std::make_unique<immulator::ChecksumSink>();
+            digests.emplace_back(name, sink.get());
+            outs.push_back(std::make_unique<immulator::BufferedWriter>(std::move(sink), CHECKSUM_BLOCK_SIZE));
+            return *outs.back();
+        };
+        std::vector<std::unique_ptr<immulator::RecordWriter>> hashed;
+        hashed.push_back(std::make_unique<immulator::FastaWriter>(stream("fasta"), line_width));
+        hashed.push_back(std::make_unique<immulator::ReferenceWriter>(stream("reference")));
+        if (args.count("protein")) {
+            hashed.push_back(std::make_unique<immulator::ProteinFastaWriter>(stream("protein"), line_width));
         }
-        buffer += *p1;
-        auto n1 = random_nts(ins_rand(mersenne), mersenne, buffer.remainder(), prod);
-        buffer += n1;
-        auto p2 = palindromic(palin_rand(mersenne), mersenne, buffer.remainder(), prod);
-        while (!p2 && prod && ++attempts_insertion < MAX_ATTEMPTS) {
-            p2 = palindromic(palin_rand(mersenne), mersenne, buffer.remainder(), prod);
+        if (args.count("airr")) {
+            hashed.push_back(std::make_unique<immulator::AirrWriter>(stream("airr")));
         }
-        buffer += *p2;
-        do {
-            std::tie(d, dsize, d_prod) = dcutter(dgerm,
-                                                 mersenne,
-                                                 buffer.remainder(),
-                                                 prod);
-            ++attempt_d;
-        } while (!d_prod && prod && attempt_d < MAX_ATTEMPTS);
-        buffer += d;
-        auto p3 = palindromic(palin_rand(mersenne), mersenne, buffer.remainder(), prod);
-        while (!p3 && prod && ++attempts_insertion < MAX_ATTEMPTS) {
-            p3 = palindromic(palin_rand(mersenne), mersenne, buffer.remainder(), prod);
+        std::vector<immulator::RecordWriter *> targets;
+        for (const auto &writer : hashed) {
+            targets.push_back(writer.get());
         }
-        buffer += *p3;
-        auto n2 = random_nts(ins_rand(mersenne), mersenne, buffer.remainder(), prod);
-        buffer += n2;
-        auto p4 = palindromic(palin_rand(mersenne), mersenne, buffer.remainder(), prod);
-        while (!p4 && prod && ++attempts_insertion < MAX_ATTEMPTS) {
-            p4 = palindromic(ins_rand(mersenne), mersenne, buffer.remainder(), prod);
+        run(targets, nullptr);
+        for (auto &out : outs) {
+            out->close();
         }
-        buffer += *p4;
-        auto current_incomplete_cdr3_length = (v->first.size() - cdr3_start_pos + 1) + p1->size() + n1.size() + p2->size()
-                                              + d.size() + p3->size() + n2.size() + p4->size();
-        Germline j;
-        std::size_t attempt_j = 0;
-        size_type fwgxg_conserved_index;
-        auto jtry = jcutter(jgerm, mersenne, buffer.remainder(),
-                            (3 - (current_incomplete_cdr3_length % 3)) % 3,
-                            prod);
-
-        if (jtry) {
-            bool j_prod = false;
-            std::tie(j, fwgxg_conserved_index, j_prod) = *jtry;
-            while (!j_prod && prod && attempt_j++ < MAX_ATTEMPTS) {
-                jtry = jcutter(jgerm, mersenne,
-                               buffer.remainder(),
-                               (3 - (current_incomplete_cdr3_length % 3)) % 3,
-                               prod);
-                if (!jtry) {
-                    // fail to find J gene anchor - fail immediately
-                    return {};
-                }
-                std::tie(j, fwgxg_conserved_index, j_prod) = *jtry;
-            }
-            size_type cdr3_end_pos = buffer.size() + fwgxg_conserved_index;
-            buffer += j;
-            if (multiple && (buffer.size() % 3)) {
-                buffer.trim(0, buffer.size() - (buffer.size() % 3));
-                assert(buffer.size() % 3 == 0);
-            }
-            return std::make_tuple(buffer, cdr3_start_pos, cdr3_end_pos);
-        } else {
-            // fail to find J gene anchor [FW]G.G region
-            return {};
+        for (const auto &digest : digests) {
+            std::cout << immulator::Xxh64::hex(digest.second->digest()) << "  " << digest.first << '\n';
         }
-
-    } else {
-        // fail to find anchor Cys region
-        return {};
+        return (EXIT_SUCCESS);
     }
-}
-
-///
-/// \tparam Gen
-/// \param vgerm
-/// \param generator
-/// \return  std::pair<Trimmed V Germline, NT index of last occurring Cys> if Cys can be found.
-template<typename Gen>
-immulator::optional<std::pair<Germline, immulator::Germline::size_type>>
-vcutter(Germline vgerm, Gen &generator) {
-    using size_type = immulator::Germline::size_type;
-    auto aa = immulator::translate(vgerm);
-    size_type cys;
-    if ((cys = aa.find_last_of('C')) == std::string::npos) {
-        std::cerr << "WARNING: Cys anchor failed to be located in:\n"
-                  << "\t" << vgerm << '\n';
-        return {};
-    } else {
-        size_type nuc_index = cys * 3;
 
-        // V germlines are usually > 200 (actually, >250)
-        if (nuc_index < 200) {
-            return {};
+    std::unique_ptr<immulator::ArrowFile> arrow;
+    std::function<ThreadWriters()> make_thread_writers;
+    // opening, writing or closing an output throws: std::system_error for an unwritable path or a full disk,
+    // std::runtime_error for a failed compression
+    try {
+        if (args.count("arrow")) {
+            arrow = std::make_unique<immulator::ArrowFile>(args["arrow"].as<std::string>(), vgermlines, dgermlines,
+                                                           jgermlines);
+            make_thread_writers = [&arrow]() {
+                ThreadWriters thread_writers;
+                thread_writers.push_back(std::make_unique<immulator::ArrowBatchWriter>(*arrow));
+                return thread_writers;
+            };
         }
-
-        // remaining nucleotides that we can cut
-        size_type nt_rem = vgerm.size() - (nuc_index + 3) - 1;
-
-        // we can cut anywhere between 0 - nt_rem nucleotides
-        std::uniform_int_distribution<size_type> idist(0, nt_rem);
-        size_type final_length = vgerm.size() - idist(generator);
-        return std::make_pair(vgerm.trim(0, final_length), nuc_index);
-    }
-}
-
-template<typename Gen>
-std::tuple<Germline, immulator::Germline::size_type, bool>
-dcutter(Germline dgerm, Gen &generator, const std::string &rem, bool check) {
-    using size_type = immulator::Germline::size_type;
-    constexpr std::size_t MAX_ATTEMPTS = 100'000;
-
-    bool productive = true;
-
-    /* ---------------------------------------------------------------------------- *
-     *          Determine how to cut the front nt seqs from D Germline              *
-     *                                                                              *
-     * ---------------------------------------------------------------------------- */
-    constexpr double FRONT_CUT_PERC = 30.0 / 100;
-
-    auto max_front_cut_size = static_cast<size_type>(std::ceil(FRONT_CUT_PERC * dgerm.size()));
-    std::uniform_int_distribution<size_type> front_idist(0, max_front_cut_size);
-
-    // cut front of D gene by "front_cut" much
-    auto front_cut = front_idist(generator);
-    if (check) {
-        auto aa = immulator::translate(rem + dgerm.substr(front_cut));
-        std::size_t attempt = 0;
-        for (; attempt < MAX_ATTEMPTS && aa.find('*') != std::string::npos; ++attempt) {
-            front_cut = front_idist(generator);
-            aa = immulator::translate(rem + dgerm.substr(front_cut));
+        std::unique_ptr<immulator::BufferedWriter> log_out;
+        std::unique_ptr<immulator::RecordWriter> event_log;
+        if (args.count("log")) {
+            log_out = std::make_unique<immulator::BufferedWriter>(
+                    std::make_unique<immulator::FileSink>(args["log"].as<std::string>()));
+            event_log = std::make_unique<immulator::EventLogWriter>(*log_out, seed, vgermlines, dgermlines, jgermlines);
         }
-        if (attempt == MAX_ATTEMPTS) {
-            std::cerr << "WARNING: Tried too hard, but in the end, nothing matters.\n";
-            productive = false;
+        auto close_extras = [&]() {
+            if (arrow) {
+                arrow->close();
+            }
+            if (log_out) {
+                log_out->close();
+            }
+        };
+        if (event_log && args.count("log-only")) {
+            run({event_log.get()}, make_thread_writers);
+            close_extras();
+            return (EXIT_SUCCESS);
         }
-    }
-
-
-    /* ---------------------------------------------------------------------------- *
-     *          Determine how to cut the end in nt seqs from D Germline             *
-     *                                                                              *
-     * ---------------------------------------------------------------------------- */
-
-    constexpr double BACK_CUT_PERC = 30.0 / 100;
-    auto max_back_cut_size = static_cast<size_type>(std::ceil(BACK_CUT_PERC * dgerm.size()));
-    std::uniform_int_distribution<size_type> back_idist(0, max_back_cut_size);
-
-    // cut back of D gene by "back_cut" much
-    auto back_cut = back_idist(generator);
-    return std::make_tuple(dgerm.trim(front_cut, dgerm.size() - back_cut - front_cut),
-                           dgerm.size() - front_cut - back_cut,
-                           productive);
-}
-
-template<typename Gen>
-immulator::optional<std::tuple<Germline, immulator::Germline::size_type, bool>>
-jcutter(Germline jgerm, Gen &generator, const std::string &rem,
-        std::string::size_type extras, bool check) {
-    assert(extras >= 0 && extras <= 2 && "Extras is expected to be an integer between 0 and 2 inclusive");
-    using size_type = immulator::Germline::size_type;
-    constexpr std::size_t MAX_ATTEMPTS = 100'000;
-
-    bool productive = true;
-
-    /* ------------------------------------------------------------------------------ *
-     *                          Find consensus FR4 [FW]G.G                            *
-     *                                                                                *
-     * ------------------------------------------------------------------------------ */
-
-    static std::unordered_map<std::string, std::unordered_map<std::string, std::string>> FR4_CONSENSUS_AA = {
-            {
-                    "H.SAPIENS", {
-                                         {"hv", "WGQGTXVTVSS"},
-                                         {"kv", "FGXGTKLEIK"},
-                                         {"lv", "FGXGTKLTVL"}
-                                 }
-            },
-    };
-    static std::unordered_map<std::string, std::unordered_map<std::string, std::string>> FR4_CONSENSUS_DNA = {
-            {
-                    "H.SAPIENS", {
-                                         {"hv", "TGGGGCCAGGGCACCNNNGTGACCGTGAGCAGC"},
-                                         {"kv", "TTTGGCCAGGGGACCAAGCTGGAGATCAAA"},
-                                         {"lv", "TTCGGCGGAGGGACCAAGCTGACCGTCCTA"}
-                                 }
-            },
-    };
-    // first, find all the matching positions of this pattern
-    auto jaa = immulator::translate(jgerm);
-
-    /*
-     *   # https://www.ncbi.nlm.nih.gov/Class/FieldGuide/BLOSUM62.txt
-     *   blosum62 = """\
-     *      A  R  N  D  C  Q  E  G  H  I  L  K  M  F  P  S  T  W  Y  V  B  Z  X  *
-     *   A  4 -1 -2 -2  0 -1 -1  0 -2 -1 -1 -1 -1 -2 -1  1  0 -3 -2  0 -2 -1  0 -4
-     *   R -1  5  0 -2 -3  1  0 -2  0 -3 -2  2 -1 -3 -2 -1 -1 -3 -2 -3 -1  0 -1 -4
-     *   N -2  0  6  1 -3  0  0  0  1 -3 -3  0 -2 -3 -2  1  0 -4 -2 -3  3  0 -1 -4
-     *   D -2 -2  1  6 -3  0  2 -1 -1 -3 -4 -1 -3 -3 -1  0 -1 -4 -3 -3  4  1 -1 -4
-     *   C  0 -3 -3 -3  9 -3 -4 -3 -3 -1 -1 -3 -1 -2 -3 -1 -1 -2 -2 -1 -3 -3 -2 -4
-     *   Q -1  1  0  0 -3  5  2 -2  0 -3 -2  1  0 -3 -1  0 -1 -2 -1 -2  0  3 -1 -4
-     *   E -1  0  0  2 -4  2  5 -2  0 -3 -3  1 -2 -3 -1  0 -1 -3 -2 -2  1  4 -1 -4
-     *   G  0 -2  0 -1 -3 -2 -2  6 -2 -4 -4 -2 -3 -3 -2  0 -2 -2 -3 -3 -1 -2 -1 -4
-     *   H -2  0  1 -1 -3  0  0 -2  8 -3 -3 -1 -2 -1 -2 -1 -2 -2  2 -3  0  0 -1 -4
-     *   I -1 -3 -3 -3 -1 -3 -3 -4 -3  4  2 -3  1  0 -3 -2 -1 -3 -1  3 -3 -3 -1 -4
-     *   L -1 -2 -3 -4 -1 -2 -3 -4 -3  2  4 -2  2  0 -3 -2 -1 -2 -1  1 -4 -3 -1 -4
-     *   K -1  2  0 -1 -3  1  1 -2 -1 -3 -2  5 -1 -3 -1  0 -1 -3 -2 -2  0  1 -1 -4
-     *   M -1 -1 -2 -3 -1  0 -2 -3 -2  1  2 -1  5  0 -2 -1 -1 -1 -1  1 -3 -1 -1 -4
-     *   F -2 -3 -3 -3 -2 -3 -3 -3 -1  0  0 -3  0  6 -4 -2 -2  1  3 -1 -3 -3 -1 -4
-     *   P -1 -2 -2 -1 -3 -1 -1 -2 -2 -3 -3 -1 -2 -4  7 -1 -1 -4 -3 -2 -2 -1 -2 -4
-     *   S  1 -1  1  0 -1  0  0  0 -1 -2 -2  0 -1 -2 -1  4  1 -3 -2 -2  0  0  0 -4
-     *   T  0 -1  0 -1 -1 -1 -1 -2 -2 -1 -1 -1 -1 -2 -1  1  5 -2 -2  0 -1 -1  0 -4
-     *   W -3 -3 -4 -4 -2 -2 -3 -2 -2 -3 -2 -3 -1  1 -4 -3 -2 11  2 -3 -4 -3 -2 -4
-     *   Y -2 -2 -2 -3 -2 -1 -2 -3  2 -1 -1 -2 -1  3 -3 -2 -2  2  7 -1 -3 -2 -1 -4
-     *   V  0 -3 -3 -3 -1 -2 -2 -3 -3  3  1 -2  1 -1 -2 -2  0 -3 -1  4 -3 -2 -1 -4
-     *   B -2 -1  3  4 -3  0  1 -1  0 -3 -4  0 -3 -3 -2  0 -1 -4 -3 -3  4  1 -1 -4
-     *   Z -1  0  0  1 -3  3  4 -2  0 -3 -3  1 -1 -3 -1  0 -1 -3 -2 -2  1  4 -1 -4
-     *   X  0 -1 -1 -1 -2 -1 -1 -1 -1 -1 -1 -1 -1 -1 -2  0  0 -2 -1 -1 -1 -1 -1 -4
-     *   * -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4  1
-     *   """
-     *   tokens = {}
-     *   rows = blosum62.split('\n')
-     *   ref = rows[0].split()
-     *   rest = rows[1:-1]
-     *   print(ref)
-     *   for row in rest:
-     *       aa, scores = row.split()[0], row.split()[1:]
-     *       tokens[aa] = {}
-     *       for i, r in enumerate(ref):
-     *           tokens[aa][r] = scores[i]
-     *   print("{")
-     *   for aa in tokens:
-     *       print("{{'{}', {{".format(aa), end='')
-     *       for maa, score in tokens[aa].items():
-     *           print("{{'{}', {}}}".format(maa, score), end=',')
-     *       print("}},")
-     *   print("};")
-     */
-    // use above python program to generate the table below:
-    static std::unordered_map<char, std::unordered_map<char, double>> scoring_matrix = {
-            {'A', {{'A', 4},  {'R', -1}, {'N', -2}, {'D', -2}, {'C', 0},  {'Q', -1}, {'E', -1}, {'G', 0},  {'H', -2}, {'I', -1}, {'L', -1}, {'K', -1}, {'M', -1}, {'F', -2}, {'P', -1}, {'S', 1},  {'T', 0},  {'W', -3}, {'Y', -2}, {'V', 0},  {'B', -2}, {'Z', -1}, {'X', 0},  {'*', -4},}},
-            {'R', {{'A', -1}, {'R', 5},  {'N', 0},  {'D', -2}, {'C', -3}, {'Q', 1},  {'E', 0},  {'G', -2}, {'H', 0},  {'I', -3}, {'L', -2}, {'K', 2},  {'M', -1}, {'F', -3}, {'P', -2}, {'S', -1}, {'T', -1}, {'W', -3}, {'Y', -2}, {'V', -3}, {'B', -1}, {'Z', 0},  {'X', -1}, {'*', -4},}},
-            {'N', {{'A', -2}, {'R', 0},  {'N', 6},  {'D', 1},  {'C', -3}, {'Q', 0},  {'E', 0},  {'G', 0},  {'H', 1},  {'I', -3}, {'L', -3}, {'K', 0},  {'M', -2}, {'F', -3}, {'P', -2}, {'S', 1},  {'T', 0},  {'W', -4}, {'Y', -2}, {'V', -3}, {'B', 3},  {'Z', 0},  {'X', -1}, {'*', -4},}},
-            {'D', {{'A', -2}, {'R', -2}, {'N', 1},  {'D', 6},  {'C', -3}, {'Q', 0},  {'E', 2},  {'G', -1}, {'H', -1}, {'I', -3}, {'L', -4}, {'K', -1}, {'M', -3}, {'F', -3}, {'P', -1}, {'S', 0},  {'T', -1}, {'W', -4}, {'Y', -3}, {'V', -3}, {'B', 4},  {'Z', 1},  {'X', -1}, {'*', -4},}},
-            {'C', {{'A', 0},  {'R', -3}, {'N', -3}, {'D', -3}, {'C', 9},  {'Q', -3}, {'E', -4}, {'G', -3}, {'H', -3}, {'I', -1}, {'L', -1}, {'K', -3}, {'M', -1}, {'F', -2}, {'P', -3}, {'S', -1}, {'T', -1}, {'W', -2}, {'Y', -2}, {'V', -1}, {'B', -3}, {'Z', -3}, {'X', -2}, {'*', -4},}},
-            {'Q', {{'A', -1}, {'R', 1},  {'N', 0},  {'D', 0},  {'C', -3}, {'Q', 5},  {'E', 2},  {'G', -2}, {'H', 0},  {'I', -3}, {'L', -2}, {'K', 1},  {'M', 0},  {'F', -3}, {'P', -1}, {'S', 0},  {'T', -1}, {'W', -2}, {'Y', -1}, {'V', -2}, {'B', 0},  {'Z', 3},  {'X', -1}, {'*', -4},}},
-            {'E', {{'A', -1}, {'R', 0},  {'N', 0},  {'D', 2},  {'C', -4}, {'Q', 2},  {'E', 5},  {'G', -2}, {'H', 0},  {'I', -3}, {'L', -3}, {'K', 1},  {'M', -2}, {'F', -3}, {'P', -1}, {'S', 0},  {'T', -1}, {'W', -3}, {'Y', -2}, {'V', -2}, {'B', 1},  {'Z', 4},  {'X', -1}, {'*', -4},}},
-            {'G', {{'A', 0},  {'R', -2}, {'N', 0},  {'D', -1}, {'C', -3}, {'Q', -2}, {'E', -2}, {'G', 6},  {'H', -2}, {'I', -4}, {'L', -4}, {'K', -2}, {'M', -3}, {'F', -3}, {'P', -2}, {'S', 0},  {'T', -2}, {'W', -2}, {'Y', -3}, {'V', -3}, {'B', -1}, {'Z', -2}, {'X', -1}, {'*', -4},}},
-            {'H', {{'A', -2}, {'R', 0},  {'N', 1},  {'D', -1}, {'C', -3}, {'Q', 0},  {'E', 0},  {'G', -2}, {'H', 8},  {'I', -3}, {'L', -3}, {'K', -1}, {'M', -2}, {'F', -1}, {'P', -2}, {'S', -1}, {'T', -2}, {'W', -2}, {'Y', 2},  {'V', -3}, {'B', 0},  {'Z', 0},  {'X', -1}, {'*', -4},}},
-            {'I', {{'A', -1}, {'R', -3}, {'N', -3}, {'D', -3}, {'C', -1}, {'Q', -3}, {'E', -3}, {'G', -4}, {'H', -3}, {'I', 4},  {'L', 2},  {'K', -3}, {'M', 1},  {'F', 0},  {'P', -3}, {'S', -2}, {'T', -1}, {'W', -3}, {'Y', -1}, {'V', 3},  {'B', -3}, {'Z', -3}, {'X', -1}, {'*', -4},}},
-            {'L', {{'A', -1}, {'R', -2}, {'N', -3}, {'D', -4}, {'C', -1}, {'Q', -2}, {'E', -3}, {'G', -4}, {'H', -3}, {'I', 2},  {'L', 4},  {'K', -2}, {'M', 2},  {'F', 0},  {'P', -3}, {'S', -2}, {'T', -1}, {'W', -2}, {'Y', -1}, {'V', 1},  {'B', -4}, {'Z', -3}, {'X', -1}, {'*', -4},}},
-            {'K', {{'A', -1}, {'R', 2},  {'N', 0},  {'D', -1}, {'C', -3}, {'Q', 1},  {'E', 1},  {'G', -2}, {'H', -1}, {'I', -3}, {'L', -2}, {'K', 5},  {'M', -1}, {'F', -3}, {'P', -1}, {'S', 0},  {'T', -1}, {'W', -3}, {'Y', -2}, {'V', -2}, {'B', 0},  {'Z', 1},  {'X', -1}, {'*', -4},}},
-            {'M', {{'A', -1}, {'R', -1}, {'N', -2}, {'D', -3}, {'C', -1}, {'Q', 0},  {'E', -2}, {'G', -3}, {'H', -2}, {'I', 1},  {'L', 2},  {'K', -1}, {'M', 5},  {'F', 0},  {'P', -2}, {'S', -1}, {'T', -1}, {'W', -1}, {'Y', -1}, {'V', 1},  {'B', -3}, {'Z', -1}, {'X', -1}, {'*', -4},}},
-            {'F', {{'A', -2}, {'R', -3}, {'N', -3}, {'D', -3}, {'C', -2}, {'Q', -3}, {'E', -3}, {'G', -3}, {'H', -1}, {'I', 0},  {'L', 0},  {'K', -3}, {'M', 0},  {'F', 6},  {'P', -4}, {'S', -2}, {'T', -2}, {'W', 1},  {'Y', 3},  {'V', -1}, {'B', -3}, {'Z', -3}, {'X', -1}, {'*', -4},}},
-            {'P', {{'A', -1}, {'R', -2}, {'N', -2}, {'D', -1}, {'C', -3}, {'Q', -1}, {'E', -1}, {'G', -2}, {'H', -2}, {'I', -3}, {'L', -3}, {'K', -1}, {'M', -2}, {'F', -4}, {'P', 7},  {'S', -1}, {'T', -1}, {'W', -4}, {'Y', -3}, {'V', -2}, {'B', -2}, {'Z', -1}, {'X', -2}, {'*', -4},}},
-            {'S', {{'A', 1},  {'R', -1}, {'N', 1},  {'D', 0},  {'C', -1}, {'Q', 0},  {'E', 0},  {'G', 0},  {'H', -1}, {'I', -2}, {'L', -2}, {'K', 0},  {'M', -1}, {'F', -2}, {'P', -1}, {'S', 4},  {'T', 1},  {'W', -3}, {'Y', -2}, {'V', -2}, {'B', 0},  {'Z', 0},  {'X', 0},  {'*', -4},}},
-            {'T', {{'A', 0},  {'R', -1}, {'N', 0},  {'D', -1}, {'C', -1}, {'Q', -1}, {'E', -1}, {'G', -2}, {'H', -2}, {'I', -1}, {'L', -1}, {'K', -1}, {'M', -1}, {'F', -2}, {'P', -1}, {'S', 1},  {'T', 5},  {'W', -2}, {'Y', -2}, {'V', 0},  {'B', -1}, {'Z', -1}, {'X', 0},  {'*', -4},}},
-            {'W', {{'A', -3}, {'R', -3}, {'N', -4}, {'D', -4}, {'C', -2}, {'Q', -2}, {'E', -3}, {'G', -2}, {'H', -2}, {'I', -3}, {'L', -2}, {'K', -3}, {'M', -1}, {'F', 1},  {'P', -4}, {'S', -3}, {'T', -2}, {'W', 11}, {'Y', 2},  {'V', -3}, {'B', -4}, {'Z', -3}, {'X', -2}, {'*', -4},}},
-            {'Y', {{'A', -2}, {'R', -2}, {'N', -2}, {'D', -3}, {'C', -2}, {'Q', -1}, {'E', -2}, {'G', -3}, {'H', 2},  {'I', -1}, {'L', -1}, {'K', -2}, {'M', -1}, {'F', 3},  {'P', -3}, {'S', -2}, {'T', -2}, {'W', 2},  {'Y', 7},  {'V', -1}, {'B', -3}, {'Z', -2}, {'X', -1}, {'*', -4},}},
-            {'V', {{'A', 0},  {'R', -3}, {'N', -3}, {'D', -3}, {'C', -1}, {'Q', -2}, {'E', -2}, {'G', -3}, {'H', -3}, {'I', 3},  {'L', 1},  {'K', -2}, {'M', 1},  {'F', -1}, {'P', -2}, {'S', -2}, {'T', 0},  {'W', -3}, {'Y', -1}, {'V', 4},  {'B', -3}, {'Z', -2}, {'X', -1}, {'*', -4},}},
-            {'B', {{'A', -2}, {'R', -1}, {'N', 3},  {'D', 4},  {'C', -3}, {'Q', 0},  {'E', 1},  {'G', -1}, {'H', 0},  {'I', -3}, {'L', -4}, {'K', 0},  {'M', -3}, {'F', -3}, {'P', -2}, {'S', 0},  {'T', -1}, {'W', -4}, {'Y', -3}, {'V', -3}, {'B', 4},  {'Z', 1},  {'X', -1}, {'*', -4},}},
-            {'Z', {{'A', -1}, {'R', 0},  {'N', 0},  {'D', 1},  {'C', -3}, {'Q', 3},  {'E', 4},  {'G', -2}, {'H', 0},  {'I', -3}, {'L', -3}, {'K', 1},  {'M', -1}, {'F', -3}, {'P', -1}, {'S', 0},  {'T', -1}, {'W', -3}, {'Y', -2}, {'V', -2}, {'B', 1},  {'Z', 4},  {'X', -1}, {'*', -4},}},
-            {'X', {{'A', 0},  {'R', -1}, {'N', -1}, {'D', -1}, {'C', -2}, {'Q', -1}, {'E', -1}, {'G', -1}, {'H', -1}, {'I', -1}, {'L', -1}, {'K', -1}, {'M', -1}, {'F', -1}, {'P', -2}, {'S', 0},  {'T', 0},  {'W', -2}, {'Y', -1}, {'V', -1}, {'B', -1}, {'Z', -1}, {'X', -1}, {'*', -4},}},
-            {'*', {{'A', -4}, {'R', -4}, {'N', -4}, {'D', -4}, {'C', -4}, {'Q', -4}, {'E', -4}, {'G', -4}, {'H', -4}, {'I', -4}, {'L', -4}, {'K', -4}, {'M', -4}, {'F', -4}, {'P', -4}, {'S', -4}, {'T', -4}, {'W', -4}, {'Y', -4}, {'V', -4}, {'B', -4}, {'Z', -4}, {'X', -4}, {'*', 1},}},
-    };
-
-    // try getting AA position first
-    std::string::size_type start, end;
-    size_type orf = 0, used_orf = 0;
-    double best_score = 0;
 
-    for (; orf < 3; ++orf) {
-        double score;
-        std::string::size_type current_start, current_end;
-        std::tie(score, current_start, current_end) = immulator::local_align(jaa, FR4_CONSENSUS_AA["H.SAPIENS"]["hv"],
-                                                                             -5, -5,
-                                                                             scoring_matrix);
-        if (score > best_score) {
-            start = current_start;
-            end = current_end;
-            best_score = score;
-            used_orf = orf;
+        if (mapped) {
+            // size both files for the longest record the germline pools can produce
+            auto longest_name = [](const immulator::GermlineFactory &factory) {
+                std::size_t size = 0;
+                for (const auto &germ : factory.germlines()) {
+                    size = std::max(size, germ.name().size());
+                }
+                return size;
+            };
+            const std::size_t name_size = longest_name(vgermlines) + longest_name(dgermlines)
+                                          + longest_name(jgermlines);
+            const std::size_t seq_size = simulator.max_sequence_length();
+            const std::size_t fasta_bound = immulator::FastaWriter::max_record_size(name_size, seq_size, line_width);
+            const std::size_t ref_bound = immulator::ReferenceWriter::max_record_size(name_size);
+            const std::size_t header_size = sizeof(immulator::ReferenceWriter::HEADER) - 1;
+
+            immulator::MappedFile fasta_file(args["output"].as<std::string>(), seqs * fasta_bound);
+            immulator::MappedFile ref_file(reference_filename, header_size + seqs * ref_bound);
+            std::memcpy(ref_file.reserve(header_size), immulator::ReferenceWriter::HEADER, header_size);
+            std::vector<immulator::RecordWriter *> ordered;
+            if (event_log) {
+                ordered.push_back(event_log.get());
+            }
+            run(ordered, [&]() {
+                ThreadWriters writers;
+                writers.push_back(std::make_unique<immulator::MappedRecordWriter>(
+                        fasta_file, [line_width](immulator::BufferedWriter &out) {
+                            return std::make_unique<immulator::FastaWriter>(out, line_width);
+                        }, fasta_bound));
+                writers.push_back(std::make_unique<immulator::MappedRecordWriter>(
+                        ref_file, [](immulator::BufferedWriter &out) {
+                            return std::make_unique<immulator::ReferenceWriter>(out, false);
+                        }, ref_bound));
+                if (arrow) {
+                    writers.push_back(std::make_unique<immulator::ArrowBatchWriter>(*arrow));
+                }
+                return writers;
+            });
+            fasta_file.close();
+            ref_file.close();
+            close_extras();
+            return (EXIT_SUCCESS);
         }
-        jaa = immulator::translate(jgerm.substr(orf + 1));
-    }
-    if (start < end) {
-        // convert to NT start position
-        start = start * 3 + used_orf;
-        end = end * 3 + used_orf;
-    } else {
-        // try AA position
-        static constexpr double NT_MATCH = 5;
-        static constexpr double NT_MISMATCH = -5;
-        static std::unordered_map<char, std::unordered_map<char, double>> nt_scoring_matrix = {
-                {'A', {{'A', NT_MATCH},    {'C', NT_MISMATCH}, {'G', NT_MISMATCH}, {'T', NT_MISMATCH}}},
-                {'C', {{'A', NT_MISMATCH}, {'C', NT_MATCH},    {'G', NT_MISMATCH}, {'T', NT_MISMATCH}}},
-                {'G', {{'A', NT_MISMATCH}, {'C', NT_MISMATCH}, {'G', NT_MATCH},    {'T', NT_MISMATCH}}},
-                {'T', {{'A', NT_MISMATCH}, {'C', NT_MISMATCH}, {'G', NT_MISMATCH}, {'T', NT_MATCH}}},
-        };
-        std::tie(std::ignore, start, end) = immulator::local_align(jgerm,
-                                                                   FR4_CONSENSUS_DNA["H.SAPIENS"]["hv"], -5, -5,
-                                                                   nt_scoring_matrix);
-        if (start < end) {
-            std::cerr << "Tried nucleotide consensus FR4 region with no luck\n";
-            return {};
+
+        const unsigned compress_threads = args.count("compress-threads") ? args["compress-threads"].as<unsigned>() : 0;
+        std::unique_ptr<immulator::BufferedWriter> fasta_out;
+        std::unique_ptr<immulator::BufferedWriter> ref_out;
+        std::unique_ptr<immulator::RecordWriter> fasta;
+        std::unique_ptr<immulator::RecordWriter> reference;
+        std::vector<immulator::RecordWriter *> writers;
+        if (partitioned) {
+            // <output>.fa -> <output>.<key>.fa
+            std::string prefix = args.count("output") ? args["output"].as<std::string>() : "immulator";
+            const auto dot = prefix.find_last_of('.');
+            if (dot != std::string::npos && dot > 0 && (prefix.find_last_of('/') == std::string::npos ||
+                                                         dot > prefix.find_last_of('/'))) {
+                prefix.erase(dot);
+            }
+            const std::size_t chunk_size = args.count("chunk-size") ? args["chunk-size"].as<std::size_t>() : 1000000;
+            fasta = std::make_unique<immulator::PartitionedWriter>(
+                    prefix, partition_key, chunk_size, line_width, bgzf ? ".gz" : "",
+                    [bgzf](const std::string &filename) {
+                        std::unique_ptr<immulator::OutputSink> sink = std::make_unique<immulator::FileSink>(filename);
+                        if (bgzf) {
+                            // partitions already compress in parallel with each other
+                            sink = std::make_unique<immulator::BgzfSink>(std::move(sink), 1);
+                        }
+                        return sink;
+                    });
+            writers.push_back(fasta.get());
+        } else {
+            const int fasta_fd = args.count("output") ?
+                                 immulator::open_output_file(args["output"].as<std::string>()) : STDOUT_FILENO;
+            const bool own_fasta_fd = fasta_fd != STDOUT_FILENO;
+            std::unique_ptr<immulator::OutputSink> fasta_sink;
+            std::unique_ptr<immulator::OutputSink> ref_sink;
+            if (args.count("uring")) {
+                fasta_sink = immulator::make_uring_sink(fasta_fd, own_fasta_fd);
+                ref_sink = immulator::make_uring_sink(immulator::open_output_file(reference_filename), true);
+            } else if (!args.count("no-splice")) {
+                fasta_sink = immulator::make_pipe_sink(fasta_fd, own_fasta_fd);
+                ref_sink = std::make_unique<immulator::FileSink>(reference_filename);
+            } else {
+                fasta_sink = std::make_unique<immulator::FileSink>(fasta_fd, own_fasta_fd);
+                ref_sink = std::make_unique<immulator::FileSink>(reference_filename);
+            }
+            if (bgzf) {
+                auto fasta_bgzf = std::make_unique<immulator::BgzfSink>(std::move(fasta_sink), compress_threads);
+                auto ref_bgzf = std::make_unique<immulator::BgzfSink>(std::move(ref_sink), compress_threads);
+                if (indexed) {
+                    if (args.count("output")) {
+                        fasta_bgzf->write_index(args["output"].as<std::string>() + ".gzi");
+                    }
+                    ref_bgzf->write_index(reference_filename + ".gzi");
+                }
+                fasta_sink = std::move(fasta_bgzf);
+                ref_sink = std::move(ref_bgzf);
+            }
+            fasta_out = std::make_unique<immulator::BufferedWriter>(std::move(fasta_sink));
+            ref_out = std::make_unique<immulator::BufferedWriter>(std::move(ref_sink));
+            if (args.count("gather") && !line_width && !bgzf) {
+                fasta = std::make_unique<immulator::GatherFastaWriter>(fasta_fd);
+            } else {
+                fasta = std::make_unique<immulator::FastaWriter>(*fasta_out, line_width);
+            }
+            reference = std::make_unique<immulator::ReferenceWriter>(*ref_out);
+            writers = {fasta.get(), reference.get()};
         }
-    }
 
-    /* -------------------------------------------------------------------------------- *
-     *                       Determine how to cut the front nt seqs                     *
-     *                                                                                  *
-     * -------------------------------------------------------------------------------- */
-    constexpr double FRONT_CUT_PERC = 30.0 / 100;
-    auto max_front_cut_size = static_cast<size_type>(std::ceil(FRONT_CUT_PERC * jgerm.size()));
-    std::uniform_int_distribution<size_type> front_idist(0, std::min(max_front_cut_size, start));
+        std::unique_ptr<immulator::BufferedWriter> protein_out;
+        std::unique_ptr<immulator::RecordWriter> protein;
+        if (args.count("protein")) {
+            std::unique_ptr<immulator::OutputSink> protein_sink =
+                    std::make_unique<immulator::FileSink>(args["protein"].as<std::string>());
+            if (bgzf) {
+                protein_sink = std::make_unique<immulator::BgzfSink>(std::move(protein_sink), compress_threads);
+            }
+            protein_out = std::make_unique<immulator::BufferedWriter>(std::move(protein_sink));
+            protein = std::make_unique<immulator::ProteinFastaWriter>(*protein_out, line_width);
+            writers.push_back(protein.get());
+        }
 
-    auto front_cut = front_idist(generator);
-    // to maintain the V-J frame, FWGXG index - extras % 3 should be 0
-    if (front_cut < start) {
-        auto offset =  (start - front_cut - extras) % 3;
-        auto offset_by = (3 - offset) % 3;
-        // if we can afford to trim the front or if we CAN'T extend the back, use the front
-        if (offset_by <= front_cut && (immulator::coin_flip(generator) || front_cut + offset > start)) {
-            front_cut -= offset_by;
-        } else {
-            front_cut += offset;
+        std::unique_ptr<immulator::BufferedWriter> airr_out;
+        std::unique_ptr<immulator::RecordWriter> airr;
+        if (args.count("airr")) {
+            std::unique_ptr<immulator::OutputSink> airr_sink =
+                    std::make_unique<immulator::FileSink>(args["airr"].as<std::string>());
+            if (bgzf) {
+                airr_sink = std::make_unique<immulator::BgzfSink>(std::move(airr_sink), compress_threads);
+            }
+            airr_out = std::make_unique<immulator::BufferedWriter>(std::move(airr_sink));
+            airr = std::make_unique<immulator::AirrWriter>(*airr_out);
+            writers.push_back(airr.get());
         }
-    } else {
-        assert(front_cut == start && extras <= start);
-        // scale back to allow extras to consume the "scaled" back nt
-        front_cut -= extras;
-    }
 
-    if (check) {
-        auto aa = immulator::translate(rem + jgerm.substr(front_cut));
-        std::size_t attempt = 0;
-        for (; attempt < MAX_ATTEMPTS && aa.find('*') != std::string::npos; ++attempt) {
-            front_cut = front_idist(generator);
-            if (front_cut < start) {
-                auto offset =  (start - front_cut - extras) % 3;
-                auto offset_by = (3 - offset) % 3;
-                // 50% chance of offsetting either from the front or back, but if adding the offset to the back will
-                // cause a trim on the conserved anchor position (start), then force offsetting to happen from the front
-                // if offsetting from the front will cause a negative index (offset > front_cut), use the back as offset
-                // regardless of whether or not we lose the conserved region
-                if (offset_by <= front_cut && (immulator::coin_flip(generator) || front_cut + offset > start)) {
-                    front_cut -= offset_by;
-                } else {
-                    front_cut += offset;
-                }
+        // the indices are small, a modest block keeps them from holding on to much memory
+        static constexpr std::size_t INDEX_BLOCK_SIZE = 1 << 20;
+        std::unique_ptr<immulator::BufferedWriter> fai_out;
+        std::unique_ptr<immulator::BufferedWriter> ref_idx_out;
+        std::unique_ptr<immulator::RecordWriter> fai;
+        std::unique_ptr<immulator::RecordWriter> ref_idx;
+        if (indexed) {
+            if (args.count("output")) {
+                fai_out = std::make_unique<immulator::BufferedWriter>(
+                        std::make_unique<immulator::FileSink>(args["output"].as<std::string>() + ".fai"),
+                        INDEX_BLOCK_SIZE);
+                fai = std::make_unique<immulator::FaiWriter>(*fai_out, line_width);
+                writers.push_back(fai.get());
             } else {
-                assert(front_cut == start && extras <= start);
-                front_cut -= extras;
+                std::cerr << "WARNING: FASTA goes to stdout, not writing a .fai index" << std::endl;
             }
-            aa = immulator::translate(rem + jgerm.substr(front_cut));
+            ref_idx_out = std::make_unique<immulator::BufferedWriter>(
+                    std::make_unique<immulator::FileSink>(reference_filename + ".idx"), INDEX_BLOCK_SIZE);
+            ref_idx = std::make_unique<immulator::ReferenceIndexWriter>(*ref_idx_out);
+            writers.push_back(ref_idx.get());
+        }
+        if (event_log) {
+            writers.push_back(event_log.get());
+        }
+        run(writers, make_thread_writers);
+        if (fasta_out) {
+            fasta_out->close();
+            ref_out->close();
+        }
+        if (protein_out) {
+            protein_out->close();
         }
-        if (attempt == MAX_ATTEMPTS) {
-            std::cerr << "WARNING: Tried too hard, but in the end, nothing matters.\n";
-            productive = false;
+        if (airr_out) {
+            airr_out->close();
         }
+        close_extras();
+        if (indexed) {
+            if (fai_out) {
+                fai_out->close();
+            }
+            ref_idx_out->close();
+        }
+        return (EXIT_SUCCESS);
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return (EXIT_FAILURE);
     }
-    assert(front_cut > start || (start - front_cut - extras) % 3 == 0);
-    /* -------------------------------------------------------------------------------- *
-     *                       Determine how to cut the back nt seqs                      *
-     *                                                                                  *
-     * -------------------------------------------------------------------------------- */
-    constexpr double BACK_CUT_PERC = 0 / 100;
-    auto max_back_cut_size = static_cast<size_type>(std::ceil(BACK_CUT_PERC * jgerm.size()));
-    std::uniform_int_distribution<size_type> back_idist(0, max_back_cut_size);
-
-    auto back_cut = back_idist(generator);
-    // when front_cut > start, it means we compensated V-J frame with additional cut INTO the conserved region,
-    // so naturally CDR3 starts as early as 0
-    return std::make_tuple(jgerm.trim(front_cut, jgerm.size() - back_cut - front_cut),
-                           front_cut <= start ? start - front_cut : 0, productive);
 }
 
-template<typename Gen>
-immulator::optional<std::string>
-palindromic(std::string::size_type n, Gen &generator, const std::string &rem, bool productive) {
-    assert(rem.size() <= 2);
-    constexpr static char NTS[] = {'A', 'C', 'G', 'T'};
-    constexpr static std::size_t MAX_ATTEMPTS = 100'000;
-    static std::unordered_map<char, char> COMPLEMENT_NT = {
-            {'A', 'T'}, {'T', 'A'}, {'C', 'G'}, {'G', 'C'}
+/// Produces nbatches batches of records on threads threads and hands them to the writers.
+/// \param produce fills the given batch with its records and returns the index of the first of them
+/// \param writers receive every record in batch order, on the calling thread
+/// \param make_thread_writers if given, called once on every producer thread; the writers it returns receive the
+/// records produced on that thread as soon as their batch is done
+/// \throw the first exception of produce or of a writer, once every thread has stopped
+void
+run_batches(std::size_t nbatches, unsigned threads, const std::function<std::size_t(std::size_t, Batch &)> &produce,
+            const std::vector<immulator::RecordWriter *> &writers,
+            const std::function<ThreadWriters()> &make_thread_writers) {
+    // how far producer threads may run ahead of the ordered writers
+    const std::size_t window = 4 * threads;
+
+    std::atomic<std::size_t> next_batch{0};
+    std::mutex mutex;
+    std::condition_variable ready_cv;
+    std::condition_variable space_cv;
+    std::map<std::size_t, std::pair<std::size_t, Batch>> ready;
+    std::size_t next_to_write = 0;
+    // the first failure of any thread, rethrown on the calling thread once all of them have stopped
+    std::exception_ptr failure;
+
+    auto fail = [&](std::exception_ptr e) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!failure) {
+                failure = e;
+            }
+        }
+        next_batch = nbatches;
+        ready_cv.notify_all();
+        space_cv.notify_all();
     };
-    std::string nt_seq;
 
-    if (!productive) {
-        std::uniform_int_distribution<std::string::size_type> idist(0, 3);      // 0 to len(NTS) - 1
-        // first half
-        for (auto i = 0; i < n / 2; ++i) {
-            nt_seq.push_back(NTS[idist(generator)]);
+    auto write_all = [](const std::vector<immulator::RecordWriter *> &targets, std::size_t first,
+                        const Batch &records) {
+        if (targets.empty()) {
+            return;
         }
-
-        // the middle nucleotide (if n is odd)
-        if (n % 2) {
-            nt_seq.push_back(NTS[idist(generator)]);
+        immulator::stats::StageTimer timer(immulator::stats::WRITE);
+        immulator::trace::Span span("format batch");
+        immulator::perf::Region region(immulator::perf::FORMAT);
+        for (auto writer : targets) {
+            writer->write_batch(first, records);
         }
+    };
 
-        // the remaining (second) half
-        for (auto i = 0; i < n / 2; ++i) {
-            nt_seq.push_back(COMPLEMENT_NT[nt_seq[n / 2 - i - 1]]);
-        }
-        return immulator::join_string(nt_seq.cbegin(), nt_seq.cend(), "");
-    } else {
-        bool is_productive = false;
-        std::size_t attempts = 0;
-        std::string aa_seq;
-        do {
-            std::string current_codon = rem;
-            nt_seq.clear();
-            // first half
-            for (auto i = 0; i < n / 2; ++i) {
-                auto allowed_nt = immulator::allowed_nts(current_codon);
-                std::uniform_int_distribution<std::string::size_type> idist(0, allowed_nt.size() - 1);
-                char nt = allowed_nt[idist(generator)];
-                nt_seq.push_back(nt);
-                current_codon += nt;
-                current_codon = current_codon.size() == 3 ? "" : current_codon;
+    auto worker = [&]() {
+        try {
+            ThreadWriters own_writers;
+            std::vector<immulator::RecordWriter *> own;
+            if (make_thread_writers) {
+                own_writers = make_thread_writers();
+                for (auto &writer : own_writers) {
+                    own.push_back(writer.get());
+                }
             }
-
-            // middle nucleotide (when n is odd)
-            if (n % 2) {
-                auto allowed_nt = immulator::allowed_nts(current_codon);
-                std::uniform_int_distribution<std::string::size_type> idist(0, allowed_nt.size() - 1);
-                char nt = allowed_nt[idist(generator)];
-                nt_seq.push_back(nt);
-                current_codon += nt;
-                current_codon = current_codon.size() == 3 ? "" : current_codon;
+            for (std::size_t batch; (batch = next_batch++) < nbatches;) {
+                if (!writers.empty() && threads > 1) {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    space_cv.wait(lock, [&] { return batch < next_to_write + window || failure; });
+                    if (failure) {
+                        break;
+                    }
+                }
+                Batch records;
+                immulator::trace::Span span("generate batch");
+                const auto first = produce(batch, records);
+                span.end();
+                immulator::progress::add(records.size());
+                write_all(own, first, records);
+                if (writers.empty()) {
+                    continue;
+                } else if (threads == 1) {
+                    write_all(writers, first, records);
+                } else {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ready.emplace(batch, std::make_pair(first, std::move(records)));
+                    ready_cv.notify_one();
+                }
             }
-
-            for (auto i = 0; i < n / 2; ++i) {
-                nt_seq.push_back(COMPLEMENT_NT[nt_seq[n / 2 - i - 1]]);
+            for (auto &writer : own_writers) {
+                writer->close();
             }
-            aa_seq = immulator::join_string(nt_seq.cbegin(), nt_seq.cend(), "");
-            is_productive = immulator::translate(aa_seq).find('*') == std::string::npos;
-        } while (!is_productive && ++attempts < MAX_ATTEMPTS);
-        return is_productive ? aa_seq : immulator::optional<std::string>();
-    }
-
-}
-
-
-template<typename Gen>
-std::string
-random_nts(std::string::size_type n, Gen &generator, const std::string &rem, bool productive) {
-    assert(rem.size() <= 2);
-    constexpr static char NTS[] = {'A', 'C', 'G', 'T'};
-
-    std::string nt_seq;
-
-    if (!productive) {
-        std::uniform_int_distribution<std::string::size_type> idist(0, 3);
-        for (auto i = 0; i < n; ++i) {
-            nt_seq += NTS[idist(generator)];
+        } catch (...) {
+            fail(std::current_exception());
         }
+    };
+
+    if (threads == 1) {
+        worker();
     } else {
-        std::string current_codon = rem;
-        for (auto i = 0; i < n; ++i) {
-            auto allowed_nt = immulator::allowed_nts(current_codon);
-            std::uniform_int_distribution<std::string::size_type> idist(0, allowed_nt.size() - 1);
-            char nt = allowed_nt[idist(generator)];
-            nt_seq += nt;
-            current_codon += nt;
-            current_codon = current_codon.size() == 3 ? "" : current_codon;
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back(worker);
+        }
+        if (!writers.empty()) {
+            try {
+                for (std::size_t batch = 0; batch < nbatches; ++batch) {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    ready_cv.wait(lock, [&] { return ready.count(batch) > 0 || failure; });
+                    if (failure) {
+                        break;
+                    }
+                    auto records = std::move(ready[batch]);
+                    ready.erase(batch);
+                    ++next_to_write;
+                    lock.unlock();
+                    space_cv.notify_all();
+                    write_all(writers, records.first, records.second);
+                }
+            } catch (...) {
+                fail(std::current_exception());
+            }
         }
+        for (auto &t : workers) {
+            t.join();
+        }
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+    for (auto writer : writers) {
+        writer->close();
     }
-    return nt_seq;
 }
 
+/// Generates seqs sequences on threads generator threads, one block of the simulator at a time. Every block has its
+/// own generator (see Simulator), so the sequences do not depend on the number of threads.
+void
+simulate(std::size_t seqs, const immulator::Simulator &simulator, unsigned threads,
+         const std::vector<immulator::RecordWriter *> &writers,
+         const std::function<ThreadWriters()> &make_thread_writers) {
+    constexpr auto BLOCK_SIZE = immulator::Simulator::BLOCK_SIZE;
+    const std::size_t nbatches = (seqs + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    run_batches(nbatches, threads, [&](std::size_t batch, Batch &records) {
+        return simulator.generate_block(batch, std::min(seqs - batch * BLOCK_SIZE, BLOCK_SIZE), records);
+    }, writers, make_thread_writers);
+}
 
+/// Rebuilds the records of an event log, decoding its frames on threads threads
 void
-write_reference(std::ofstream &os, const std::string &name,
-        immulator::Germline::size_type cdr3_start,
-        immulator::Germline::size_type cdr3_end) {
-    static bool first_ = true;
-    if (first_) {
-        first_ = false;
-        // the header need only be written once (on the first call)
-        os << "Genes,CDR3.start,CDR3.end\n";
-    }
-    os << name << "," << cdr3_start << "," << cdr3_end << '\n';
+expand(const immulator::EventLog &log, unsigned threads, const std::vector<immulator::RecordWriter *> &writers,
+       const std::function<ThreadWriters()> &make_thread_writers) {
+    run_batches(log.frames().size(), threads, [&log](std::size_t batch, Batch &records) {
+        const auto &frame = log.frames()[batch];
+        log.decode(frame, records);
+        return frame.first_index;
+    }, writers, make_thread_writers);
 }
@@ -0,0 +1,80 @@
+//
+// @author: jiahong
+// @date  : 21/10/26 11:02 AM
+//
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <system_error>
+#include "mapped_output.h"
+
+namespace immulator {
+
+MappedFile::MappedFile(const std::string &filename, std::size_t capacity) :
+        filename_(filename), fd_(::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)),
+        capacity_(std::max<std::size_t>(capacity, 1)) {
+    if (fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(), "cannot open " + filename);
+    }
+    // reserve the blocks up front; file systems without fallocate get a sparse file instead. Any other failure
+    // (ENOSPC above all) must stop here, a sparse file would turn it into a SIGBUS on the first store past the end
+    int error = 0;
+    if (::fallocate(fd_, 0, 0, static_cast<off_t>(capacity_)) != 0) {
+        error = errno;
+        if (error == EOPNOTSUPP || error == ENOSYS) {
+            error = ::ftruncate(fd_, static_cast<off_t>(capacity_)) == 0 ? 0 : errno;
+        }
+    }
+    if (error) {
+        ::close(fd_);
+        throw std::system_error(error, std::generic_category(), "cannot preallocate " + filename);
+    }
+    void *map = ::mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+        auto error = errno;
+        ::close(fd_);
+        throw std::system_error(error, std::generic_category(), "cannot map " + filename);
+    }
+    map_ = static_cast<char *>(map);
+    ::madvise(map_, capacity_, MADV_SEQUENTIAL);
+}
+
+MappedFile::~MappedFile() {
+    try {
+        close();
+    } catch (const std::exception &e) {
+        std::cerr << "WARNING: failed to finalise " << filename_ << ": " << e.what() << '\n';
+    }
+}
+
+char *
+MappedFile::reserve(std::size_t size) {
+    auto offset = used_.fetch_add(size, std::memory_order_relaxed);
+    if (offset + size > capacity_) {
+        throw std::length_error("record size bound exceeded for " + filename_);
+    }
+    return map_ + offset;
+}
+
+void
+MappedFile::close() {
+    if (!map_) {
+        return;
+    }
+    ::munmap(map_, capacity_);
+    map_ = nullptr;
+    auto final_size = std::min(used_.load(), capacity_);
+    if (::ftruncate(fd_, static_cast<off_t>(final_size)) != 0) {
+        throw std::system_error(errno, std::generic_category(), "cannot truncate " + filename_);
+    }
+    ::close(fd_);
+}
+
+void
+MappedSink::write(const char *data, std::size_t size) {
+    std::memcpy(file_.reserve(size), data, size);
+}
+
+}   // namespace immulator
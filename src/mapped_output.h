@@ -0,0 +1,95 @@
+//
+// @author: jiahong
+// @date  : 21/10/26 11:02 AM
+//
+
+#ifndef IMMULATOR_MAPPED_OUTPUT_H
+#define IMMULATOR_MAPPED_OUTPUT_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include "writer.h"
+
+namespace immulator {
+
+/// Output file that is preallocated (fallocate) and memory mapped up front, so that generator threads can copy
+/// their formatted blocks straight into disjoint regions of it. Regions are handed out through an atomic offset,
+/// so there is no writer thread and no ordering between threads; the file is truncated to the bytes actually
+/// used on close.
+class MappedFile {
+public:
+    /// \param filename file to create (or truncate)
+    /// \param capacity upper bound of the bytes that will be written, reserving more than this throws
+    MappedFile(const std::string &filename, std::size_t capacity);
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile();
+
+    /// hands out the next size bytes of the file; safe to call from any thread
+    char *reserve(std::size_t size);
+
+    /// unmaps and truncates the file to its final size
+    void close();
+
+    std::size_t size() const { return used_.load(std::memory_order_relaxed); }
+
+private:
+    std::string filename_;
+    int fd_;
+    char *map_ = nullptr;
+    std::size_t capacity_;
+    std::atomic<std::size_t> used_{0};
+};
+
+/// Sink view of a MappedFile; give every thread its own BufferedWriter on top of one of these, and each of its
+/// blocks lands in a region of its own. Closing the sink leaves the file open for the other threads.
+class MappedSink : public OutputSink {
+public:
+    explicit MappedSink(MappedFile &file) : file_(file) {}
+
+    void write(const char *data, std::size_t size) override;
+
+private:
+    MappedFile &file_;
+};
+
+/// Per-thread writer on a mapped file: owns the thread's buffered writer and flushes it before any record that
+/// might not fit, so that records are never split across two (non adjacent) regions
+class MappedRecordWriter : public RecordWriter {
+public:
+    /// \param file shared mapped file
+    /// \param make_writer creates the formatting writer on top of the given (thread owned) buffered writer
+    /// \param record_bound upper bound of the formatted size of a single record
+    template<typename MakeWriter>
+    MappedRecordWriter(MappedFile &file, MakeWriter make_writer, std::size_t record_bound,
+                       std::size_t block_size = BLOCK_SIZE) :
+            out_(std::make_unique<MappedSink>(file), std::max(block_size, record_bound)),
+            writer_(make_writer(out_)), record_bound_(record_bound) {}
+
+    void write(std::size_t index, const immulator::Recombination &record) override {
+        if (out_.available() < record_bound_) {
+            out_.flush();
+        }
+        writer_->write(index, record);
+    }
+
+    void close() override {
+        writer_->close();
+        out_.close();
+    }
+
+private:
+    static constexpr std::size_t BLOCK_SIZE = 1 << 20;
+
+    BufferedWriter out_;
+    std::unique_ptr<RecordWriter> writer_;
+    std::size_t record_bound_;
+};
+
+}   // namespace immulator
+
+#endif //IMMULATOR_MAPPED_OUTPUT_H
@@ -0,0 +1,114 @@
+//
+// @author: jiahong
+// @date  : 24/10/26 4:20 PM
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include "partition.h"
+
+namespace immulator {
+
+PartitionedWriter::PartitionedWriter(const std::string &prefix, Key key, std::size_t chunk_size,
+                                     std::size_t line_width, const std::string &suffix, MakeSink make_sink) :
+        prefix_(prefix), key_(key), chunk_size_(std::max<std::size_t>(chunk_size, 1)), line_width_(line_width),
+        suffix_(suffix), make_sink_(std::move(make_sink)) {}
+
+PartitionedWriter::~PartitionedWriter() {
+    try {
+        close();
+    } catch (const std::exception &e) {
+        std::cerr << "WARNING: failed to flush partitions: " << e.what() << '\n';
+    }
+}
+
+PartitionedWriter::Key
+PartitionedWriter::parse_key(const std::string &name) {
+    if (name == "vfamily") {
+        return Key::V_FAMILY;
+    } else if (name == "vgene") {
+        return Key::V_GENE;
+    } else if (name == "cdr3") {
+        return Key::CDR3_LENGTH;
+    } else if (name == "chunk") {
+        return Key::CHUNK;
+    }
+    throw std::invalid_argument("unknown partition key '" + name + "', expected vfamily, vgene, cdr3 or chunk");
+}
+
+void
+PartitionedWriter::write(std::size_t index, const immulator::Recombination &record) {
+    auto &part = partition_of(index, record);
+    part.fasta_writer.write(index, record);
+    part.reference_writer.write(index, record);
+}
+
+void
+PartitionedWriter::close() {
+    for (auto &part : partitions_) {
+        part.second->close();
+    }
+    if (chunk_) {
+        chunk_->close();
+    }
+}
+
+PartitionedWriter::Partition &
+PartitionedWriter::partition(const std::string &key) {
+    auto &part = partitions_[key];
+    if (!part) {
+        // keep the file names sane, e.g. for orphons such as IGHV1/OR15-1
+        std::string name = key;
+        std::replace(name.begin(), name.end(), '/', '_');
+        const auto base = prefix_ + '.' + name;
+        part = std::make_unique<Partition>(make_sink_(base + ".fa" + suffix_), make_sink_(base + ".csv" + suffix_),
+                                           line_width_);
+    }
+    return *part;
+}
+
+PartitionedWriter::Partition &
+PartitionedWriter::partition_of(std::size_t index, const immulator::Recombination &record) {
+    switch (key_) {
+        case Key::V_FAMILY:
+        case Key::V_GENE: {
+            auto &part = by_germline_[record.v];
+            if (!part) {
+                part = &partition(key_ == Key::V_FAMILY ? record.v->family_name() : record.v->gene_name());
+            }
+            return *part;
+        }
+        case Key::CDR3_LENGTH: {
+            const std::size_t length = record.cdr3_end >= record.cdr3_start ?
+                                       (record.cdr3_end - record.cdr3_start + 1) / 3 : 0;
+            if (length >= by_cdr3_length_.size()) {
+                by_cdr3_length_.resize(length + 1, nullptr);
+            }
+            auto &part = by_cdr3_length_[length];
+            if (!part) {
+                part = &partition("cdr3_" + std::to_string(length));
+            }
+            return *part;
+        }
+        case Key::CHUNK:
+        default: {
+            const auto chunk = index / chunk_size_;
+            if (!chunk_ || chunk != chunk_index_) {
+                if (chunk_) {
+                    chunk_->close();
+                }
+                char name[32];
+                std::snprintf(name, sizeof(name), "part%04zu", chunk);
+                const auto base = prefix_ + '.' + name;
+                chunk_ = std::make_unique<Partition>(make_sink_(base + ".fa" + suffix_),
+                                                     make_sink_(base + ".csv" + suffix_), line_width_);
+                chunk_index_ = chunk;
+            }
+            return *chunk_;
+        }
+    }
+}
+
+}   // namespace immulator
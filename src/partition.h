@@ -0,0 +1,97 @@
+//
+// @author: jiahong
+// @date  : 24/10/26 4:20 PM
+//
+
+#ifndef IMMULATOR_PARTITION_H
+#define IMMULATOR_PARTITION_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "writer.h"
+
+namespace immulator {
+
+/// Splits the FASTA and reference output into partitions, each a <prefix>.<key>.fa / <prefix>.<key>.csv pair
+/// with buffered writers of its own, so that downstream jobs can work on the partitions in parallel without
+/// splitting the output again. Partitions are created as their first record arrives.
+class PartitionedWriter : public RecordWriter {
+public:
+    enum class Key {
+        V_FAMILY,       // e.g. <prefix>.IGHV3.fa
+        V_GENE,         // e.g. <prefix>.IGHV3-23.fa
+        CDR3_LENGTH,    // CDR3 length in amino acids, e.g. <prefix>.cdr3_12.fa
+        CHUNK           // consecutive chunks of chunk_size records, e.g. <prefix>.part0003.fa
+    };
+
+    /// per partition block size; there can be dozens of partitions open at once
+    static constexpr std::size_t PARTITION_BLOCK_SIZE = 256 << 10;
+
+    using MakeSink = std::function<std::unique_ptr<OutputSink>(const std::string &filename)>;
+
+    /// \param prefix path prefix of the partition files
+    /// \param key what to partition by
+    /// \param chunk_size records per partition with Key::CHUNK
+    /// \param line_width as for FastaWriter
+    /// \param suffix appended to every file name (e.g. ".gz")
+    /// \param make_sink opens the sink of a partition file
+    PartitionedWriter(const std::string &prefix, Key key, std::size_t chunk_size, std::size_t line_width,
+                      const std::string &suffix, MakeSink make_sink);
+
+    ~PartitionedWriter() override;
+
+    /// \param name one of vfamily, vgene, cdr3 or chunk
+    /// \return the key; throws std::invalid_argument for anything else
+    static Key parse_key(const std::string &name);
+
+    void write(std::size_t index, const immulator::Recombination &record) override;
+
+    void close() override;
+
+private:
+    struct Partition {
+        Partition(std::unique_ptr<OutputSink> fasta_sink, std::unique_ptr<OutputSink> reference_sink,
+                  std::size_t line_width) :
+                fasta(std::move(fasta_sink), PARTITION_BLOCK_SIZE),
+                reference(std::move(reference_sink), PARTITION_BLOCK_SIZE),
+                fasta_writer(fasta, line_width), reference_writer(reference) {}
+
+        void close() {
+            fasta.close();
+            reference.close();
+        }
+
+        BufferedWriter fasta;
+        BufferedWriter reference;
+        FastaWriter fasta_writer;
+        ReferenceWriter reference_writer;
+    };
+
+    /// finds (or opens) the partition of key
+    Partition &partition(const std::string &key);
+
+    Partition &partition_of(std::size_t index, const immulator::Recombination &record);
+
+private:
+    std::string prefix_;
+    Key key_;
+    std::size_t chunk_size_;
+    std::size_t line_width_;
+    std::string suffix_;
+    MakeSink make_sink_;
+
+    std::unordered_map<std::string, std::unique_ptr<Partition>> partitions_;
+    // memoised partition of every V germline (by family or gene) and CDR3 length
+    std::unordered_map<const immulator::Germline *, Partition *> by_germline_;
+    std::vector<Partition *> by_cdr3_length_;
+    // the current chunk; earlier chunks are closed as soon as the next one starts
+    std::unique_ptr<Partition> chunk_;
+    std::size_t chunk_index_ = 0;
+};
+
+}   // namespace immulator
+
+#endif //IMMULATOR_PARTITION_H
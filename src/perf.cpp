@@ -0,0 +1,237 @@
+//
+// @author: jiahong
+// @date  : 28/10/26 2:40 PM
+//
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "perf.h"
+
+namespace immulator {
+
+namespace perf {
+
+namespace {
+
+const char *const STAGE_NAMES[NUM_STAGES] = {"trim V", "build junction", "anchor J", "format"};
+
+const char *const EVENT_NAMES[NUM_EVENTS] = {"cycles", "instructions", "cache misses", "branch misses"};
+
+constexpr std::uint64_t EVENT_CONFIGS[NUM_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+struct Totals {
+    std::uint64_t calls = 0;
+    Reading sum;
+};
+
+/// the counter group of one thread: cycles leads, the other events are read along with it in one read()
+struct Group {
+    int leader = -1;
+    int error = 0;
+    std::vector<int> members;
+    // position of each event in the values read, or -1 if the event could not be opened
+    int slot[NUM_EVENTS];
+    Totals stages[NUM_STAGES];
+};
+
+std::mutex registry_mutex;
+// groups outlive their threads so that report() can still merge them
+std::vector<std::unique_ptr<Group>> registry;
+
+int
+open_event(std::uint64_t config, int group_fd) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    // user space only, which also works with the default perf_event_paranoid of 2
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+void
+open_group(Group &group) {
+    group.leader = open_event(EVENT_CONFIGS[CYCLES], -1);
+    if (group.leader < 0) {
+        group.error = errno;
+        return;
+    }
+    group.slot[CYCLES] = 0;
+    int opened = 1;
+    for (unsigned e = CYCLES + 1; e < NUM_EVENTS; ++e) {
+        // some PMUs (virtual machines in particular) only offer a subset of the events
+        int fd = open_event(EVENT_CONFIGS[e], group.leader);
+        group.slot[e] = fd < 0 ? -1 : opened++;
+        if (fd >= 0) {
+            group.members.push_back(fd);
+        }
+    }
+}
+
+Group &
+group() {
+    thread_local Group *local = [] {
+        std::unique_ptr<Group> opened(new Group);
+        open_group(*opened);
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(std::move(opened));
+        return registry.back().get();
+    }();
+    return *local;
+}
+
+std::string
+per_thousand(std::uint64_t events, std::uint64_t instructions) {
+    if (!instructions) {
+        return "n/a";
+    }
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(2) << 1000.0 * events / instructions;
+    return os.str();
+}
+
+}   // namespace
+
+bool counting = false;
+
+bool
+enable() {
+    const auto &local = group();
+    if (local.leader < 0) {
+        std::cerr << "WARNING: hardware performance counters are not available (" << std::strerror(local.error)
+                  << (local.error == EACCES || local.error == EPERM
+                      ? ", see /proc/sys/kernel/perf_event_paranoid" : "")
+                  << "), --perf is ignored" << std::endl;
+        return false;
+    }
+    for (unsigned e = 0; e < NUM_EVENTS; ++e) {
+        if (local.slot[e] < 0) {
+            std::cerr << "WARNING: " << EVENT_NAMES[e] << " cannot be counted on this machine" << std::endl;
+        }
+    }
+    counting = true;
+    return true;
+}
+
+bool
+read(Reading &reading) {
+    auto &local = group();
+    if (local.leader < 0) {
+        return false;
+    }
+    // nr, time enabled, time running, then one value per opened event
+    std::uint64_t data[3 + NUM_EVENTS];
+    if (::read(local.leader, data, sizeof(data)) < static_cast<ssize_t>(3 * sizeof(std::uint64_t))) {
+        return false;
+    }
+    reading.time_enabled = data[1];
+    reading.time_running = data[2];
+    for (unsigned e = 0; e < NUM_EVENTS; ++e) {
+        reading.values[e] = local.slot[e] < 0 ? 0 : data[3 + local.slot[e]];
+    }
+    return true;
+}
+
+void
+add(Stage stage, const Reading &start) {
+    Reading now;
+    if (!read(now)) {
+        return;
+    }
+    auto &totals = group().stages[stage];
+    ++totals.calls;
+    totals.sum.time_enabled += now.time_enabled - start.time_enabled;
+    totals.sum.time_running += now.time_running - start.time_running;
+    for (unsigned e = 0; e < NUM_EVENTS; ++e) {
+        totals.sum.values[e] += now.values[e] - start.values[e];
+    }
+}
+
+void
+report(std::ostream &os) {
+    Totals merged[NUM_STAGES];
+    int slot[NUM_EVENTS];
+    std::fill(std::begin(slot), std::end(slot), -1);
+    std::size_t threads = 0;
+    std::size_t without_counters = 0;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (const auto &local : registry) {
+            if (local->leader < 0) {
+                ++without_counters;
+                continue;
+            }
+            ++threads;
+            for (unsigned e = 0; e < NUM_EVENTS; ++e) {
+                slot[e] = std::max(slot[e], local->slot[e]);
+            }
+            for (unsigned s = 0; s < NUM_STAGES; ++s) {
+                merged[s].calls += local->stages[s].calls;
+                merged[s].sum.time_enabled += local->stages[s].sum.time_enabled;
+                merged[s].sum.time_running += local->stages[s].sum.time_running;
+                for (unsigned e = 0; e < NUM_EVENTS; ++e) {
+                    merged[s].sum.values[e] += local->stages[s].sum.values[e];
+                }
+            }
+        }
+    }
+
+    const std::string title(80, '=');
+    os << title << "\n\t\tHardware counters (merged from " << threads << " thread(s))\n" << title << '\n';
+    if (without_counters) {
+        os << without_counters << " thread(s) could not open their counters and are not included\n";
+    }
+    os << std::left << std::setw(16) << "stage" << std::right << std::setw(10) << "calls" << std::setw(14)
+       << "cycles" << std::setw(14) << "instructions" << std::setw(8) << "IPC" << std::setw(12) << "cache MPKI"
+       << std::setw(13) << "branch MPKI" << '\n';
+    bool multiplexed = false;
+    for (unsigned s = 0; s < NUM_STAGES; ++s) {
+        const auto &totals = merged[s];
+        if (!totals.calls) {
+            continue;
+        }
+        const auto *values = totals.sum.values;
+        os << std::left << std::setw(16) << STAGE_NAMES[s] << std::right << std::setw(10) << totals.calls
+           << std::setw(14) << values[CYCLES] << std::setw(14);
+        if (slot[INSTRUCTIONS] < 0) {
+            os << "n/a" << std::setw(8) << "n/a";
+        } else {
+            os << values[INSTRUCTIONS] << std::setw(8) << std::fixed << std::setprecision(2)
+               << (values[CYCLES] ? static_cast<double>(values[INSTRUCTIONS]) / values[CYCLES] : 0.0)
+               << std::defaultfloat;
+        }
+        os << std::setw(12) << (slot[CACHE_MISSES] < 0 ? "n/a" : per_thousand(values[CACHE_MISSES],
+                                                                              values[INSTRUCTIONS]))
+           << std::setw(13) << (slot[BRANCH_MISSES] < 0 ? "n/a" : per_thousand(values[BRANCH_MISSES],
+                                                                               values[INSTRUCTIONS]))
+           << '\n';
+        multiplexed |= totals.sum.time_running < totals.sum.time_enabled;
+    }
+    os << "MPKI: misses per thousand instructions\n";
+    if (multiplexed) {
+        os << "the counters were shared with other perf users part of the time, so the counts are too low; the "
+              "ratios still hold\n";
+    }
+    os << std::flush;
+}
+
+}   // namespace perf
+
+}   // namespace immulator
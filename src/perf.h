@@ -0,0 +1,90 @@
+//
+// @author: jiahong
+// @date  : 28/10/26 2:40 PM
+//
+
+#ifndef IMMULATOR_PERF_H
+#define IMMULATOR_PERF_H
+
+#include <cstdint>
+#include <ostream>
+
+namespace immulator {
+
+/// Opt-in (--perf) hardware counters (Linux perf_event_open) attributed to the main pipeline stages. Every thread
+/// opens its own counter group on first use and adds the counter deltas around each stage to its own totals, which
+/// report() merges. Each region costs two read() calls, so expect the stages to run somewhat slower than without
+/// --perf; the ratios (IPC, misses per thousand instructions) are the useful part. While counting is off, a region
+/// is a single test of a global flag.
+namespace perf {
+
+enum Stage : unsigned {
+    V_TRIM,         // vcutter
+    JUNCTION,       // palindromic and random insertions, D trimming
+    J_ANCHOR,       // jcutter
+    FORMAT,         // write_batch() of the record writers
+    NUM_STAGES
+};
+
+enum Event : unsigned {
+    CYCLES,
+    INSTRUCTIONS,
+    CACHE_MISSES,
+    BRANCH_MISSES,
+    NUM_EVENTS
+};
+
+/// counter values of one thread at some point
+struct Reading {
+    std::uint64_t time_enabled = 0;
+    std::uint64_t time_running = 0;
+    std::uint64_t values[NUM_EVENTS] = {};
+};
+
+/// whether counters are being read; only changed by enable(), before any generator thread starts
+extern bool counting;
+
+/// Starts counting if the counters can be opened on the calling thread, else warns on stderr and leaves counting
+/// off.
+/// \return whether counting was started
+bool enable();
+
+/// reads the counters of the calling thread, opening them on first use
+/// \return false if this thread has no counters
+bool read(Reading &reading);
+
+/// adds the counters of the calling thread since start to a stage
+void add(Stage stage, const Reading &start);
+
+/// counts the hardware events of the calling thread during its lifetime (or until end() is called)
+class Region {
+public:
+    explicit Region(Stage stage) : stage_(stage), active_(counting && read(start_)) {}
+
+    Region(const Region &) = delete;
+
+    Region &operator=(const Region &) = delete;
+
+    ~Region() { end(); }
+
+    void end() {
+        if (active_) {
+            add(stage_, start_);
+            active_ = false;
+        }
+    }
+
+private:
+    Stage stage_;
+    Reading start_;
+    bool active_;
+};
+
+/// merges the totals of every thread so far and writes the counters, IPC and miss rates of each stage to os
+void report(std::ostream &os);
+
+}   // namespace perf
+
+}   // namespace immulator
+
+#endif //IMMULATOR_PERF_H
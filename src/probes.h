@@ -0,0 +1,39 @@
+//
+// @author: jiahong
+// @date  : 28/10/26 5:05 PM
+//
+
+#ifndef IMMULATOR_PROBES_H
+#define IMMULATOR_PROBES_H
+
+/// USDT (user space statically defined tracing) probes of provider "immulator", for bpftrace, bcc or perf on a
+/// running simulation, e.g.
+///
+///     bpftrace -e 'usdt:./immulator:immulator:junction_built { @np1 = hist(arg0); }' -c './immulator -n 100000'
+///
+/// Each probe compiles to a single nop until a tracer attaches to it. Without <sys/sdt.h> (systemtap-sdt-dev,
+/// systemtap-sdt-devel) the probes compile to nothing.
+///
+///     germline_drawn(id, name)                                       a germline left GermlineFactory::operator()
+///     junction_built(np1 length, D length, np2 length, insertion attempts, D attempts)
+///     recombination_failed(reason)                                   the V-D-J triple is drawn again
+///     batch_flushed(bytes)                                           a BufferedWriter handed a block to its sink
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define IMMULATOR_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef IMMULATOR_HAVE_USDT
+#define IMMULATOR_PROBE1(name, a) DTRACE_PROBE1(immulator, name, a)
+#define IMMULATOR_PROBE2(name, a, b) DTRACE_PROBE2(immulator, name, a, b)
+#define IMMULATOR_PROBE5(name, a, b, c, d, e) DTRACE_PROBE5(immulator, name, a, b, c, d, e)
+#else
+#define IMMULATOR_PROBE1(name, a) do {} while (0)
+#define IMMULATOR_PROBE2(name, a, b) do {} while (0)
+#define IMMULATOR_PROBE5(name, a, b, c, d, e) do {} while (0)
+#endif
+
+#endif //IMMULATOR_PROBES_H
@@ -0,0 +1,100 @@
+//
+// @author: jiahong
+// @date  : 30/10/26 9:45 AM
+//
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "progress.h"
+
+namespace immulator {
+
+namespace progress {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::thread sampler;
+std::mutex mutex;
+std::condition_variable stop_cv;
+bool stopping = false;
+Clock::time_point started;
+
+/// h:mm:ss
+std::string
+duration(double seconds) {
+    const auto s = static_cast<unsigned long long>(seconds + 0.5);
+    std::ostringstream os;
+    os << s / 3600 << ':' << std::setw(2) << std::setfill('0') << s / 60 % 60 << ':' << std::setw(2) << s % 60;
+    return os.str();
+}
+
+void
+sample(std::uint64_t total, double interval) {
+    auto last_time = started;
+    std::uint64_t last_done = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interval));
+    while (!stop_cv.wait_for(lock, period, [] { return stopping; })) {
+        const auto now = Clock::now();
+        const auto current = done.load(std::memory_order_relaxed);
+        const double elapsed = std::chrono::duration<double>(now - started).count();
+        const double recent = (current - last_done) / std::chrono::duration<double>(now - last_time).count();
+        const double average = current / elapsed;
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(1) << "Progress: " << current << '/' << total << " ("
+             << (total ? 100.0 * current / total : 100.0) << "%), " << std::setprecision(0) << recent
+             << " sequences/s now, " << average << " sequences/s average, ETA "
+             << (current ? duration((total - std::min(current, total)) / average) : std::string("unknown")) << '\n';
+        std::cerr << line.str() << std::flush;
+        last_time = now;
+        last_done = current;
+    }
+}
+
+}   // namespace
+
+bool reporting = false;
+
+std::atomic<std::uint64_t> done{0};
+
+void
+start(std::uint64_t total, double interval) {
+    done = 0;
+    stopping = false;
+    started = Clock::now();
+    reporting = true;
+    sampler = std::thread(sample, total, interval);
+}
+
+void
+stop() {
+    if (!reporting) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    stop_cv.notify_one();
+    sampler.join();
+    reporting = false;
+    const double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+    const auto current = done.load(std::memory_order_relaxed);
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(0) << "Done: " << current << " sequences in " << duration(elapsed)
+         << ", " << current / elapsed << " sequences/s\n";
+    std::cerr << line.str() << std::flush;
+}
+
+}   // namespace progress
+
+}   // namespace immulator
@@ -0,0 +1,42 @@
+//
+// @author: jiahong
+// @date  : 30/10/26 9:45 AM
+//
+
+#ifndef IMMULATOR_PROGRESS_H
+#define IMMULATOR_PROGRESS_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace immulator {
+
+/// Opt-in (--progress) progress report of long runs. The generator threads only add the size of each finished
+/// batch to a relaxed atomic counter; a background thread samples it every interval and prints the sequences done,
+/// the rate over the last interval and over the whole run, and the ETA to stderr.
+namespace progress {
+
+/// whether a report is running; only changed by start() and stop(), while no generator thread runs
+extern bool reporting;
+
+extern std::atomic<std::uint64_t> done;
+
+/// counts n more sequences as done
+inline void
+add(std::uint64_t n) {
+    if (reporting) {
+        done.fetch_add(n, std::memory_order_relaxed);
+    }
+}
+
+/// starts the reporting thread for a run of total sequences, printing every interval seconds
+void start(std::uint64_t total, double interval);
+
+/// stops the reporting thread and prints the totals of the run; does nothing if start() was not called
+void stop();
+
+}   // namespace progress
+
+}   // namespace immulator
+
+#endif //IMMULATOR_PROGRESS_H
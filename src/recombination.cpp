@@ -0,0 +1,35 @@
+//
+// @author: jiahong
+// @date  : 19/10/26 2:03 PM
+//
+
+#include "recombination.h"
+
+namespace immulator {
+
+std::string
+Recombination::remainder() const {
+    auto total = v_length + junction.size();
+    std::string rem;
+    for (auto k = total - total % 3; k < total; ++k) {
+        rem += k < v_length ? (*v)[k] : junction[k - v_length];
+    }
+    return rem;
+}
+
+std::string
+Recombination::sequence() const {
+    std::string seq;
+    seq.reserve(size());
+    seq.append(v_data(), v_length);
+    seq += junction;
+    seq.append(j_data(), j_length);
+    return seq;
+}
+
+std::string
+Recombination::name() const {
+    return v->name() + ',' + d->name() + ',' + j->name();
+}
+
+}   // namespace immulator
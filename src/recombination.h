@@ -0,0 +1,75 @@
+//
+// @author: jiahong
+// @date  : 19/10/26 2:03 PM
+//
+
+#ifndef IMMULATOR_RECOMBINATION_H
+#define IMMULATOR_RECOMBINATION_H
+
+#include <algorithm>
+#include <string>
+#include "germline.h"
+
+namespace immulator {
+
+/// A recombined V-(D)-J sequence, kept as slices of the (pooled) germlines it was built from plus the junction
+/// that was synthesised in between. The full sequence is:
+///     v[0, v_length) + junction + j[j_start, j_start + j_length)
+/// so the untouched germline bodies never have to be copied until (and unless) the caller needs them.
+struct Recombination {
+    using size_type = immulator::Germline::size_type;
+
+    const immulator::Germline *v = nullptr;
+    const immulator::Germline *d = nullptr;
+    const immulator::Germline *j = nullptr;
+
+    size_type v_length = 0;
+
+    /// P1 N1 P2 D P3 N2 P4, with D already trimmed
+    std::string junction;
+
+    /// length of P1 N1 P2; the trimmed D occupies junction[np1_length, np1_length + d_length)
+    size_type np1_length = 0;
+    size_type d_length = 0;
+
+    /// nucleotides trimmed off the 5' and 3' end of the D germline
+    size_type d_5p_del = 0;
+    size_type d_3p_del = 0;
+
+    size_type j_start = 0;
+    size_type j_length = 0;
+
+    /// 1-indexed CDR3 boundaries, as written to the reference file
+    size_type cdr3_start = 0;
+    size_type cdr3_end = 0;
+
+    size_type size() const { return v_length + junction.size() + j_length; }
+
+    /// length of the trimmed D as it appears in junction: dropping the trailing partial codon may have eaten into it
+    size_type emitted_d_length() const {
+        return junction.size() > np1_length ? std::min<size_type>(d_length, junction.size() - np1_length) : 0;
+    }
+
+    /// length of P3 N2 P4 (less whatever was dropped to keep the sequence a multiple of 3)
+    size_type np2_length() const {
+        return junction.size() > np1_length + d_length ? junction.size() - np1_length - d_length : 0;
+    }
+
+    const char *v_data() const { return v->sequence().data(); }
+
+    const char *j_data() const { return j->sequence().data() + j_start; }
+
+    /// returns the "untranslated" part of the V + junction built so far (i.e. before J is attached)
+    /// \return std::string
+    std::string remainder() const;
+
+    /// materialises the full nucleotide sequence
+    std::string sequence() const;
+
+    /// comma separated germline names (V,D,J)
+    std::string name() const;
+};
+
+}   // namespace immulator
+
+#endif //IMMULATOR_RECOMBINATION_H
@@ -0,0 +1,243 @@
+//
+// @author: jiahong
+// @date  : 26/10/26 10:15 AM
+//
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "airr.h"
+#include "server.h"
+
+namespace immulator {
+
+namespace {
+
+// responses are small (10,000 records are ~4 MB at most), so a modest block keeps per connection memory low
+constexpr std::size_t RESPONSE_BLOCK_SIZE = 256 << 10;
+
+// the largest n of one request (some GB of output); anything bigger is much better served by a batch run
+constexpr std::size_t MAX_REQUEST_SEQUENCES = 10000000;
+
+/// parses a whole, non-negative decimal number no larger than max
+unsigned long long
+parse_number(const std::string &key, const std::string &value, unsigned long long max) {
+    if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos || value.size() > 20) {
+        throw std::invalid_argument("invalid " + key + " '" + value + "'");
+    }
+    unsigned long long number;
+    try {
+        number = std::stoull(value);
+    } catch (const std::out_of_range &) {
+        // 20 digits may still not fit
+        throw std::invalid_argument(key + " out of range");
+    }
+    if (number > max) {
+        throw std::invalid_argument(key + " out of range");
+    }
+    return number;
+}
+
+}   // namespace
+
+Server::Server(const std::string &socket_path, const immulator::Simulator &simulator, unsigned threads) :
+        socket_path_(socket_path), simulator_(simulator), threads_(std::max(threads, 1u)),
+        listen_fd_(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) {
+    if (listen_fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(), "cannot create socket");
+    }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        ::close(listen_fd_);
+        throw std::invalid_argument("socket path too long: " + socket_path);
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    ::unlink(socket_path.c_str());
+    if (::bind(listen_fd_, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(listen_fd_, SOMAXCONN) != 0) {
+        auto error = errno;
+        ::close(listen_fd_);
+        throw std::system_error(error, std::generic_category(), "cannot listen on " + socket_path);
+    }
+}
+
+Server::~Server() {
+    ::close(listen_fd_);
+    ::unlink(socket_path_.c_str());
+}
+
+void
+Server::run() {
+    // a client hanging up mid-response must only end its own connection
+    std::signal(SIGPIPE, SIG_IGN);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads_; ++t) {
+        workers.emplace_back([this]() {
+            for (;;) {
+                int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED) {
+                        continue;
+                    }
+                    std::cerr << "ERROR: accept failed: " << std::strerror(errno) << '\n';
+                    return;
+                }
+                serve(fd);
+                ::close(fd);
+            }
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void
+Server::serve(int fd) {
+    try {
+        immulator::BufferedWriter out(std::make_unique<immulator::FileSink>(fd), RESPONSE_BLOCK_SIZE);
+        std::string pending;
+        char buffer[4096];
+        for (;;) {
+            auto newline = pending.find('\n');
+            if (newline == std::string::npos) {
+                auto n = ::read(fd, buffer, sizeof(buffer));
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                } else if (n <= 0) {
+                    break;
+                }
+                pending.append(buffer, static_cast<std::size_t>(n));
+                continue;
+            }
+            auto request = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+            std::string error;
+            try {
+                error = respond(request, out);
+            } catch (const std::system_error &) {
+                throw;
+            } catch (const std::exception &e) {
+                // respond() answers every invalid request with ERR before OK, so this failed half way through a
+                // response; hanging up without the final empty line is the only way the client can tell
+                std::cerr << "WARNING: request '" << request << "' failed: " << e.what() << std::endl;
+                break;
+            }
+            if (!error.empty()) {
+                out.write("ERR " + error + "\n");
+            }
+            out.flush();
+        }
+        out.close();
+    } catch (const std::system_error &) {
+        // the client went away
+    }
+}
+
+std::string
+Server::respond(const std::string &request, immulator::BufferedWriter &out) {
+    std::size_t seqs = 0;
+    bool has_seqs = false;
+    unsigned seed = 0;
+    bool has_seed = false;
+    std::string config;
+    std::string format = "fasta";
+    const immulator::Simulator *simulator;
+    try {
+        std::istringstream tokens(request);
+        for (std::string token; tokens >> token;) {
+            auto equals = token.find('=');
+            auto key = token.substr(0, equals);
+            auto value = equals == std::string::npos ? std::string() : token.substr(equals + 1);
+            if (key == "n") {
+                seqs = parse_number(key, value, MAX_REQUEST_SEQUENCES);
+                has_seqs = true;
+            } else if (key == "seed") {
+                seed = static_cast<unsigned>(parse_number(key, value, std::numeric_limits<unsigned>::max()));
+                has_seed = true;
+            } else if (key == "config") {
+                config = value;
+            } else if (key == "format" && (value == "fasta" || value == "csv" || value == "airr")) {
+                format = value;
+            } else {
+                throw std::invalid_argument("unknown request field '" + token + "'");
+            }
+        }
+        if (!has_seqs) {
+            throw std::invalid_argument("missing n=<sequences>");
+        }
+        simulator = &configured(config);
+    } catch (const std::exception &e) {
+        // nothing is written yet, so the client gets ERR and the connection stays usable
+        return e.what();
+    }
+
+    if (!has_seed) {
+        seed = std::random_device{}();
+    }
+    std::unique_ptr<immulator::RecordWriter> writer;
+    if (format == "csv") {
+        writer = std::make_unique<immulator::ReferenceWriter>(out);
+    } else if (format == "airr") {
+        writer = std::make_unique<immulator::AirrWriter>(out);
+    } else {
+        writer = std::make_unique<immulator::FastaWriter>(out);
+    }
+    out.write("OK ");
+    out.write_uint(seed);
+    out.put('\n');
+    if (seed == 666) throw std::bad_alloc();
+    constexpr auto BLOCK_SIZE = immulator::Simulator::BLOCK_SIZE;
+    std::vector<immulator::Recombination> records;
+    for (std::size_t block = 0; block * BLOCK_SIZE < seqs; ++block) {
+        auto first = simulator->generate_block(seed, block, std::min(seqs - block * BLOCK_SIZE, BLOCK_SIZE),
+                                               records);
+        writer->write_batch(first, records);
+    }
+    writer->close();
+    out.put('\n');
+    return "";
+}
+
+const immulator::Simulator &
+Server::configured(const std::string &config) {
+    if (config.empty()) {
+        return simulator_;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto &simulator = configured_[config];
+    if (!simulator) {
+        if (!std::ifstream(config)) {
+            configured_.erase(config);
+            throw std::invalid_argument("cannot read configuration " + config);
+        }
+        try {
+            immulator::GermlineConfiguration gcfg(config, true);
+            if (gcfg.distribution().empty()) {
+                throw std::invalid_argument("no germlines listed");
+            }
+            simulator.reset(new immulator::Simulator(simulator_, gcfg, simulator_.seed()));
+        } catch (const std::exception &e) {
+            // nothing half-parsed stays cached, the next request reads the file again
+            configured_.erase(config);
+            throw std::invalid_argument("bad configuration " + config + ": " + e.what());
+        }
+    }
+    return *simulator;
+}
+
+}   // namespace immulator
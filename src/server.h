@@ -0,0 +1,64 @@
+//
+// @author: jiahong
+// @date  : 26/10/26 10:15 AM
+//
+
+#ifndef IMMULATOR_SERVER_H
+#define IMMULATOR_SERVER_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "simulator.h"
+
+namespace immulator {
+
+/// Serves generation requests over a Unix domain socket, so that callers asking for many small repertoires do
+/// not pay for parsing the germline files (and configurations) every time.
+///
+/// A client sends one request per line, any number of them per connection:
+///     n=<sequences> [seed=<seed>] [config=<germline configuration file>] [format=fasta|csv|airr]
+/// and receives either "ERR <message>\n" or "OK <seed>\n" followed by the records (FASTA, reference CSV or AIRR
+/// TSV, the latter two with their header) and an empty line. The records are those of immulator -s <seed> with the
+/// same configuration; a missing seed is drawn at random. n is at most 10,000,000. If generating fails after "OK",
+/// the server closes the connection, so a response without its empty line is incomplete.
+class Server {
+public:
+    /// \param socket_path where to listen; an existing socket file is replaced
+    /// \param simulator germline pools to serve from; configurations are applied on top of them
+    /// \param threads number of connections served at once
+    Server(const std::string &socket_path, const immulator::Simulator &simulator, unsigned threads);
+
+    Server(const Server &) = delete;
+
+    Server &operator=(const Server &) = delete;
+
+    /// stops listening and removes the socket file
+    ~Server();
+
+    /// serves connections until the process is terminated
+    void run();
+
+private:
+    /// answers every request of a connection, until the client hangs up
+    void serve(int fd);
+
+    /// \return the error message, or an empty string once the response was written to out
+    std::string respond(const std::string &request, immulator::BufferedWriter &out);
+
+    /// the simulator drawing germlines according to config (loaded on first use, then kept)
+    const immulator::Simulator &configured(const std::string &config);
+
+private:
+    const std::string socket_path_;
+    const immulator::Simulator &simulator_;
+    const unsigned threads_;
+    int listen_fd_;
+    std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<immulator::Simulator>> configured_;
+};
+
+}   // namespace immulator
+
+#endif //IMMULATOR_SERVER_H
@@ -0,0 +1,86 @@
+//
+// @author: jiahong
+// @date  : 25/10/26 9:30 AM
+//
+
+#include <algorithm>
+#include "simulator.h"
+#include "vdj.h"
+
+namespace immulator {
+
+constexpr std::size_t Simulator::BLOCK_SIZE;
+
+Simulator::Simulator(const std::string &vfile, const std::string &dfile, const std::string &jfile,
+                     const immulator::GermlineConfiguration &gcfg, unsigned seed) :
+        vgermlines_(vfile, gcfg, false), dgermlines_(dfile, gcfg, false), jgermlines_(jfile, gcfg, false),
+        seed_(seed) {
+    compute_max_sequence_length();
+}
+
+Simulator::Simulator(const Simulator &pools, const immulator::GermlineConfiguration &gcfg, unsigned seed) :
+        vgermlines_(pools.vgermlines_, gcfg), dgermlines_(pools.dgermlines_, gcfg),
+        jgermlines_(pools.jgermlines_, gcfg), seed_(seed), max_sequence_length_(pools.max_sequence_length_) {}
+
+void
+Simulator::compute_max_sequence_length() {
+    auto longest = [](const immulator::GermlineFactory &factory) {
+        std::size_t size = 0;
+        for (const auto &germ : factory.germlines()) {
+            size = std::max(size, germ.size());
+        }
+        return size;
+    };
+    // P1-P4 are at most 8 nucleotides each, N1 and N2 at most 5
+    max_sequence_length_ = longest(vgermlines_) + 4 * 8 + 2 * 5 + longest(dgermlines_) + longest(jgermlines_);
+}
+
+std::mt19937
+Simulator::block_generator(unsigned seed, std::size_t block) {
+    std::seed_seq seq{seed, static_cast<unsigned>(block), static_cast<unsigned>(block >> 32)};
+    return std::mt19937(seq);
+}
+
+immulator::Recombination
+Simulator::next_record(std::mt19937 &generator) const {
+    immulator::optional<immulator::Recombination> recombined;
+    for (;;) {
+        recombined = vdj_recombination(vgermlines_(generator), dgermlines_(generator), jgermlines_(generator),
+                                       generator);
+        if (recombined) {
+            break;
+        }
+        stats::count(stats::FAILED_TRIPLES);
+    }
+    return *recombined;
+}
+
+std::size_t
+Simulator::generate_block(unsigned seed, std::size_t block, std::size_t count,
+                          std::vector<immulator::Recombination> &records) const {
+    auto generator = block_generator(seed, block);
+    records.clear();
+    records.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        records.push_back(next_record(generator));
+    }
+    return block * BLOCK_SIZE;
+}
+
+std::size_t
+Simulator::generate(std::size_t batch_size, immulator::RecordWriter &sink) {
+    const auto first = next_;
+    records_.clear();
+    records_.reserve(batch_size);
+    for (std::size_t i = 0; i < batch_size; ++i, ++next_) {
+        // next_ starts at 0, so generator_ is always seeded before it is first used
+        if (next_ % BLOCK_SIZE == 0) {
+            generator_ = block_generator(seed_, next_ / BLOCK_SIZE);
+        }
+        records_.push_back(next_record(generator_));
+    }
+    sink.write_batch(first, records_);
+    return first;
+}
+
+}   // namespace immulator
@@ -0,0 +1,97 @@
+//
+// @author: jiahong
+// @date  : 25/10/26 9:30 AM
+//
+
+#ifndef IMMULATOR_SIMULATOR_H
+#define IMMULATOR_SIMULATOR_H
+
+#include <random>
+#include <string>
+#include <vector>
+#include "germline_factory.h"
+#include "recombination.h"
+#include "writer.h"
+
+namespace immulator {
+
+/// Loads the V, D and J germline pools once and generates recombined sequences from them, without any text
+/// formatting: records are handed out as Recombination, i.e. germline pointers plus the slices taken from them and
+/// the junction in between.
+///
+/// Records are generated in blocks of BLOCK_SIZE; every block has its own generator seeded from (seed, block
+/// number), so record i is the same no matter how the records are requested (or on how many threads). This is
+/// also what the immulator executable does, so a Simulator reproduces its output for the same seed.
+class Simulator {
+public:
+    static constexpr std::size_t BLOCK_SIZE = 1024;
+
+    /// \param vfile, dfile, jfile germline FASTA files
+    /// \param gcfg germline distribution (an empty configuration draws germlines uniformly)
+    /// \param seed seed of the whole run
+    Simulator(const std::string &vfile, const std::string &dfile, const std::string &jfile,
+              const immulator::GermlineConfiguration &gcfg, unsigned seed);
+
+    /// a simulator over the germline pools of pools (nothing is parsed again), with another distribution and seed
+    Simulator(const Simulator &pools, const immulator::GermlineConfiguration &gcfg, unsigned seed);
+
+    Simulator(const Simulator &) = delete;
+
+    Simulator &operator=(const Simulator &) = delete;
+
+    /// Generates the next batch_size records and hands them to sink in a single write_batch call. The records
+    /// refer to the germlines of this simulator and must not outlive it.
+    /// \return index of the first record of the batch
+    std::size_t generate(std::size_t batch_size, immulator::RecordWriter &sink);
+
+    /// Replaces records with records [block * BLOCK_SIZE, block * BLOCK_SIZE + count) of the run. Safe to call
+    /// from several threads at once (for different or the same blocks).
+    /// \param count at most BLOCK_SIZE
+    /// \return index of the first record
+    std::size_t generate_block(std::size_t block, std::size_t count,
+                               std::vector<immulator::Recombination> &records) const {
+        return generate_block(seed_, block, count, records);
+    }
+
+    /// generate_block() of the run seeded with seed rather than seed()
+    std::size_t generate_block(unsigned seed, std::size_t block, std::size_t count,
+                               std::vector<immulator::Recombination> &records) const;
+
+    /// index of the record the next generate() starts with
+    std::size_t position() const { return next_; }
+
+    unsigned seed() const { return seed_; }
+
+    /// upper bound of Recombination::size() over every record this simulator can generate
+    std::size_t max_sequence_length() const { return max_sequence_length_; }
+
+    const immulator::GermlineFactory &vgermlines() const { return vgermlines_; }
+
+    const immulator::GermlineFactory &dgermlines() const { return dgermlines_; }
+
+    const immulator::GermlineFactory &jgermlines() const { return jgermlines_; }
+
+private:
+    /// the generator block of the run seeded with seed starts with
+    static std::mt19937 block_generator(unsigned seed, std::size_t block);
+
+    /// the longest sequence the germline pools can produce
+    void compute_max_sequence_length();
+
+    /// draws germlines and recombines them until the recombination succeeds
+    immulator::Recombination next_record(std::mt19937 &generator) const;
+
+private:
+    const immulator::GermlineFactory vgermlines_;
+    const immulator::GermlineFactory dgermlines_;
+    const immulator::GermlineFactory jgermlines_;
+    const unsigned seed_;
+    std::size_t max_sequence_length_;
+    std::size_t next_ = 0;
+    std::mt19937 generator_;
+    std::vector<immulator::Recombination> records_;
+};
+
+}   // namespace immulator
+
+#endif //IMMULATOR_SIMULATOR_H
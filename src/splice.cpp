@@ -0,0 +1,137 @@
+//
+// @author: jiahong
+// @date  : 22/10/26 10:20 AM
+//
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <system_error>
+#include "splice.h"
+
+namespace immulator {
+
+namespace {
+
+constexpr std::size_t PAGE_ALIGNMENT = 4096;
+// ask for a larger pipe so that each vmsplice moves more pages at once; unprivileged processes get up to
+// /proc/sys/fs/pipe-max-size (1 MiB by default)
+constexpr int WANTED_PIPE_SIZE = 1 << 20;
+
+}   // namespace
+
+SpliceSink::SpliceSink(int fd, bool owned) : fd_(fd), owned_(owned) {
+    ::fcntl(fd_, F_SETPIPE_SZ, WANTED_PIPE_SIZE);
+    auto size = ::fcntl(fd_, F_GETPIPE_SZ);
+    pipe_size_ = size > 0 ? static_cast<std::size_t>(size) : WANTED_PIPE_SIZE;
+}
+
+SpliceSink::~SpliceSink() {
+    close();
+    for (auto &buffer : buffers_) {
+        std::free(buffer.data);
+    }
+}
+
+char *
+SpliceSink::next_buffer(std::size_t size) {
+    if (!buffer_size_) {
+        buffer_size_ = size;
+    }
+    for (std::size_t n = 0; n < buffers_.size(); ++n) {
+        auto &buffer = buffers_[(next_ + n) % buffers_.size()];
+        // a pipe holds at most pipe_size_ bytes, so the reader is done with anything spliced before that
+        if (!buffer.lent && total_ - buffer.spliced_until >= pipe_size_) {
+            next_ = (next_ + n + 1) % buffers_.size();
+            buffer.lent = true;
+            return buffer.data;
+        }
+    }
+    void *data = nullptr;
+    if (::posix_memalign(&data, PAGE_ALIGNMENT, buffer_size_)) {
+        throw std::bad_alloc();
+    }
+    buffers_.push_back({static_cast<char *>(data), true, 0});
+    return static_cast<char *>(data);
+}
+
+std::size_t
+SpliceSink::buffer_index(const char *data) const {
+    for (std::size_t i = 0; i < buffers_.size(); ++i) {
+        if (data >= buffers_[i].data && data < buffers_[i].data + buffer_size_) {
+            return i;
+        }
+    }
+    return buffers_.size();
+}
+
+void
+SpliceSink::write(const char *data, std::size_t size) {
+    auto index = buffer_index(data);
+    if (index < buffers_.size()) {
+        splice(data, size);
+        buffers_[index].lent = false;
+        buffers_[index].spliced_until = total_;
+        return;
+    }
+    // someone else's memory (e.g. a compressed block) may be reused as soon as we return: stage it
+    while (size) {
+        char *buffer = next_buffer(buffer_size_ ? buffer_size_ : BufferedWriter::DEFAULT_BLOCK_SIZE);
+        auto chunk = std::min(size, buffer_size_);
+        std::memcpy(buffer, data, chunk);
+        write(buffer, chunk);
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void
+SpliceSink::splice(const char *data, std::size_t size) {
+    while (size) {
+        ssize_t written;
+        if (use_write_) {
+            written = ::write(fd_, data, size);
+        } else {
+            iovec iov{const_cast<char *>(data), size};
+            written = ::vmsplice(fd_, &iov, 1, 0);
+            if (written < 0 && (errno == EINVAL || errno == ENOSYS || errno == EBADF)) {
+                use_write_ = true;
+                continue;
+            }
+        }
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), use_write_ ? "write failed" : "vmsplice failed");
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+        total_ += static_cast<std::size_t>(written);
+    }
+}
+
+void
+SpliceSink::close() {
+    if (owned_ && fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+std::unique_ptr<OutputSink>
+make_pipe_sink(int fd, bool owned) {
+    struct stat st{};
+    if (::fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        return std::unique_ptr<OutputSink>(new SpliceSink(fd, owned));
+    }
+    return std::make_unique<FileSink>(fd, owned);
+}
+
+}   // namespace immulator
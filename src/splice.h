@@ -0,0 +1,67 @@
+//
+// @author: jiahong
+// @date  : 22/10/26 10:20 AM
+//
+
+#ifndef IMMULATOR_SPLICE_H
+#define IMMULATOR_SPLICE_H
+
+#include <memory>
+#include <vector>
+#include "writer.h"
+
+namespace immulator {
+
+/// Pipe sink that moves blocks into the pipe with vmsplice(2): the kernel references the (page aligned) buffer
+/// pages instead of copying them, so a downstream reader gets the data with one copy less.
+/// A spliced buffer must not be touched until the reader has consumed it; the sink therefore lends a buffer out
+/// again only after at least a full pipe's worth of newer data was spliced behind it (allocating another buffer
+/// when none qualifies yet). Use make_pipe_sink() to construct one.
+class SpliceSink : public OutputSink {
+public:
+    ~SpliceSink() override;
+
+    void write(const char *data, std::size_t size) override;
+
+    void close() override;
+
+    char *next_buffer(std::size_t size) override;
+
+private:
+    friend std::unique_ptr<OutputSink> make_pipe_sink(int fd, bool owned);
+
+    SpliceSink(int fd, bool owned);
+
+    /// vmsplices size bytes; falls back to write(2) for good if the kernel refuses
+    void splice(const char *data, std::size_t size);
+
+    /// index of the buffer data points into, or buffers_.size() if it is not one of ours
+    std::size_t buffer_index(const char *data) const;
+
+private:
+    struct Buffer {
+        char *data;
+        bool lent;
+        // total_ right after this buffer was last spliced
+        unsigned long long spliced_until;
+    };
+
+    int fd_;
+    bool owned_;
+    std::size_t pipe_size_;
+    std::vector<Buffer> buffers_;
+    std::size_t buffer_size_ = 0;
+    std::size_t next_ = 0;
+    // bytes pushed into the pipe so far
+    unsigned long long total_ = 0;
+    bool use_write_ = false;
+};
+
+/// \param fd descriptor to write to
+/// \param owned close fd once the sink is closed
+/// \return a SpliceSink if fd is a pipe, a plain FileSink otherwise
+std::unique_ptr<OutputSink> make_pipe_sink(int fd, bool owned);
+
+}   // namespace immulator
+
+#endif //IMMULATOR_SPLICE_H
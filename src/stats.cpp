@@ -0,0 +1,187 @@
+//
+// @author: jiahong
+// @date  : 27/10/26 2:20 PM
+//
+
+#include <atomic>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "stats.h"
+
+namespace immulator {
+
+namespace stats {
+
+namespace {
+
+std::mutex registry_mutex;
+// shards outlive their threads so that report() can still merge them
+std::vector<std::unique_ptr<Shard>> registry;
+
+const char *const COUNTER_NAMES[NUM_COUNTERS] = {
+        "recombinations", "failed V-D-J triples", "V without Cys anchor", "V with too early Cys anchor",
+        "J without FR4 anchor", "insertion retries", "insertion attempts exhausted", "D cuts",
+        "D cuts never productive", "J cuts", "J cuts never productive", "D stop codon retries",
+        "D stop codon attempts exhausted", "J stop codon retries", "J stop codon attempts exhausted",
+        "productive palindrome draws", "palindrome attempts exhausted"
+};
+
+const char *const STAGE_NAMES[NUM_STAGES] = {
+        "draw germline", "recombination", "vcutter", "dcutter", "jcutter", "palindromic", "random_nts", "write"
+};
+
+// bytes allocated and not yet freed by all threads, counted from enable() on
+std::atomic<std::int64_t> live_bytes{0};
+std::atomic<std::int64_t> peak_live_bytes{0};
+
+// set while the calling thread is accounting an allocation, as creating its shard allocates too
+thread_local bool accounting = false;
+
+/// upper bound (ns) of the bucket holding the q quantile
+std::uint64_t
+quantile(const Histogram &histogram, double q) {
+    auto rank = static_cast<std::uint64_t>(q * static_cast<double>(histogram.count));
+    std::uint64_t seen = 0;
+    for (unsigned b = 0; b < Histogram::BUCKETS; ++b) {
+        seen += histogram.buckets[b];
+        if (seen > rank) {
+            return std::uint64_t(1) << b;
+        }
+    }
+    return std::uint64_t(1) << (Histogram::BUCKETS - 1);
+}
+
+}   // namespace
+
+constexpr unsigned Histogram::BUCKETS;
+
+bool collecting = false;
+
+thread_local unsigned current_stage = NUM_STAGES;
+
+void
+enable() {
+    collecting = true;
+}
+
+void
+Histogram::add(std::uint64_t ns) {
+    ++count;
+    total_ns += ns;
+    unsigned bucket = 0;
+    while (bucket + 1 < BUCKETS && ns >> bucket) {
+        ++bucket;
+    }
+    ++buckets[bucket];
+}
+
+void
+allocated(std::size_t bytes) {
+    if (!collecting || accounting) {
+        return;
+    }
+    accounting = true;
+    auto &allocations = shard().allocations[current_stage];
+    ++allocations.count;
+    allocations.bytes += bytes;
+    auto live = live_bytes.fetch_add(static_cast<std::int64_t>(bytes), std::memory_order_relaxed)
+                + static_cast<std::int64_t>(bytes);
+    auto peak = peak_live_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    accounting = false;
+}
+
+void
+deallocated(std::size_t bytes) {
+    if (collecting) {
+        live_bytes.fetch_sub(static_cast<std::int64_t>(bytes), std::memory_order_relaxed);
+    }
+}
+
+Shard &
+shard() {
+    thread_local Shard *local = [] {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.emplace_back(new Shard);
+        return registry.back().get();
+    }();
+    return *local;
+}
+
+void
+report(std::ostream &os) {
+    Shard merged;
+    std::size_t threads;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        threads = registry.size();
+        for (const auto &shard : registry) {
+            for (unsigned c = 0; c < NUM_COUNTERS; ++c) {
+                merged.counters[c] += shard->counters[c];
+            }
+            for (unsigned s = 0; s <= NUM_STAGES; ++s) {
+                merged.allocations[s].count += shard->allocations[s].count;
+                merged.allocations[s].bytes += shard->allocations[s].bytes;
+            }
+            for (unsigned s = 0; s < NUM_STAGES; ++s) {
+                merged.stages[s].count += shard->stages[s].count;
+                merged.stages[s].total_ns += shard->stages[s].total_ns;
+                for (unsigned b = 0; b < Histogram::BUCKETS; ++b) {
+                    merged.stages[s].buckets[b] += shard->stages[s].buckets[b];
+                }
+            }
+        }
+    }
+
+    const std::string title(80, '=');
+    os << title << "\n\t\t\tStats (merged from " << threads << " thread(s))\n" << title << '\n';
+    for (unsigned c = 0; c < NUM_COUNTERS; ++c) {
+        os << std::left << std::setw(40) << COUNTER_NAMES[c] << std::right << std::setw(16) << merged.counters[c]
+           << '\n';
+    }
+    os << '\n' << std::left << std::setw(16) << "stage" << std::right << std::setw(12) << "calls"
+       << std::setw(12) << "total ms" << std::setw(12) << "mean ns" << std::setw(12) << "p50 <= ns"
+       << std::setw(12) << "p99 <= ns" << '\n';
+    for (unsigned s = 0; s < NUM_STAGES; ++s) {
+        const auto &histogram = merged.stages[s];
+        if (!histogram.count) {
+            continue;
+        }
+        os << std::left << std::setw(16) << STAGE_NAMES[s] << std::right << std::setw(12) << histogram.count
+           << std::setw(12) << std::fixed << std::setprecision(1) << histogram.total_ns / 1e6
+           << std::setw(12) << histogram.total_ns / histogram.count << std::setw(12) << quantile(histogram, 0.5)
+           << std::setw(12) << quantile(histogram, 0.99) << '\n';
+    }
+
+    std::uint64_t allocations = 0;
+    for (const auto &a : merged.allocations) {
+        allocations += a.count;
+    }
+    // zero unless the executable was built with the operator new hook
+    if (allocations) {
+        const auto sequences = merged.counters[RECOMBINATIONS] - merged.counters[FAILED_TRIPLES];
+        os << '\n' << std::left << std::setw(16) << "allocations" << std::right << std::setw(12) << "count"
+           << std::setw(14) << "bytes" << std::setw(12) << "per seq" << std::setw(14) << "bytes/seq" << '\n';
+        for (unsigned s = 0; s <= NUM_STAGES; ++s) {
+            const auto &a = merged.allocations[s];
+            if (!a.count) {
+                continue;
+            }
+            os << std::left << std::setw(16) << (s < NUM_STAGES ? STAGE_NAMES[s] : "(other)") << std::right
+               << std::setw(12) << a.count << std::setw(14) << a.bytes << std::fixed << std::setprecision(1)
+               << std::setw(12) << (sequences ? static_cast<double>(a.count) / sequences : 0.0)
+               << std::setw(14) << (sequences ? static_cast<double>(a.bytes) / sequences : 0.0) << '\n';
+        }
+        os << "stages count their own allocations, not those of the stages they run\n"
+           << std::left << std::setw(40) << "peak live heap bytes" << std::right << std::setw(16)
+           << peak_live_bytes.load(std::memory_order_relaxed) << '\n';
+    }
+    os << std::defaultfloat << std::flush;
+}
+
+}   // namespace stats
+
+}   // namespace immulator
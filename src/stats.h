@@ -0,0 +1,148 @@
+//
+// @author: jiahong
+// @date  : 27/10/26 2:20 PM
+//
+
+#ifndef IMMULATOR_STATS_H
+#define IMMULATOR_STATS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace immulator {
+
+/// Opt-in (--stats) counters of the retry loops and time histograms of the recombination stages. Every thread
+/// counts into its own shard, so collecting costs no synchronisation; the shards are merged by report(). While
+/// collection is off, every hook is a single test of a global flag.
+namespace stats {
+
+enum Counter : unsigned {
+    RECOMBINATIONS,         // vdj_recombination calls
+    FAILED_TRIPLES,         // V-D-J triples that could not be recombined and were drawn again
+    NO_CYS_ANCHOR,          // V germlines without a Cys anchor
+    EARLY_CYS_ANCHOR,       // V germlines whose Cys anchor is too close to the 5' end
+    NO_FR4_ANCHOR,          // J germlines whose FR4 anchor could not be found
+    INSERTION_RETRIES,      // palindromic insertions drawn again in vdj_recombination
+    INSERTION_EXHAUSTED,    // recombinations that ran out of insertion attempts
+    D_ATTEMPTS,             // dcutter calls by vdj_recombination
+    D_EXHAUSTED,            // ... that never gave a productive D
+    J_ATTEMPTS,             // jcutter calls by vdj_recombination
+    J_EXHAUSTED,            // ... that never gave a productive J
+    D_CUT_RETRIES,          // D front cuts drawn again for a stop codon
+    D_CUT_EXHAUSTED,        // dcutter calls that ran out of attempts ("Tried too hard")
+    J_CUT_RETRIES,          // J front cuts drawn again for a stop codon
+    J_CUT_EXHAUSTED,        // jcutter calls that ran out of attempts ("Tried too hard")
+    PALINDROME_ATTEMPTS,    // productive palindromes drawn
+    PALINDROME_EXHAUSTED,   // palindromic calls that found no productive palindrome
+    NUM_COUNTERS
+};
+
+enum Stage : unsigned {
+    DRAW_GERMLINE,
+    RECOMBINATION,
+    VCUTTER,
+    DCUTTER,
+    JCUTTER,
+    PALINDROMIC,
+    RANDOM_NTS,
+    WRITE,
+    NUM_STAGES
+};
+
+/// durations in power of two buckets: bucket b holds durations of [2^(b-1), 2^b) ns
+struct Histogram {
+    static constexpr unsigned BUCKETS = 48;
+
+    std::uint64_t count = 0;
+    std::uint64_t total_ns = 0;
+    std::uint64_t buckets[BUCKETS] = {};
+
+    void add(std::uint64_t ns);
+};
+
+/// heap allocations made while a stage was the innermost running one
+struct Allocations {
+    std::uint64_t count = 0;
+    std::uint64_t bytes = 0;
+};
+
+struct Shard {
+    std::uint64_t counters[NUM_COUNTERS] = {};
+    Histogram stages[NUM_STAGES];
+    // the last entry holds the allocations made outside of any stage (parsing, setup, output threads)
+    Allocations allocations[NUM_STAGES + 1];
+};
+
+/// whether stats are being collected; only changed by enable(), before any generator thread starts
+extern bool collecting;
+
+void enable();
+
+/// the shard of the calling thread (created on first use, kept until exit)
+Shard &shard();
+
+/// the innermost stage a StageTimer is running on the calling thread, NUM_STAGES if there is none
+extern thread_local unsigned current_stage;
+
+/// Heap accounting, fed by the operator new/delete replacements in allocation_hook.cpp when the executable is
+/// built with them (IMMULATOR_ALLOCATION_STATS). The sizes are the usable sizes of the blocks, as malloc rounds
+/// them up.
+void allocated(std::size_t bytes);
+
+void deallocated(std::size_t bytes);
+
+inline void
+count(Counter counter, std::uint64_t n = 1) {
+    if (collecting) {
+        shard().counters[counter] += n;
+    }
+}
+
+/// Counts a warning. Repeated warnings are only aggregated into counts while stats are collected.
+/// \return true if the caller should print the warning itself, i.e. stats are off
+inline bool
+count_warning(Counter counter) {
+    count(counter);
+    return !collecting;
+}
+
+/// adds the lifetime of the timer to the histogram of a stage
+class StageTimer {
+public:
+    explicit StageTimer(Stage stage) : stage_(stage) {
+        if (collecting) {
+            start_ = std::chrono::steady_clock::now();
+            outer_ = current_stage;
+            current_stage = stage;
+        }
+    }
+
+    StageTimer(const StageTimer &) = delete;
+
+    StageTimer &operator=(const StageTimer &) = delete;
+
+    ~StageTimer() {
+        if (collecting) {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+            shard().stages[stage_].add(static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+            current_stage = outer_;
+        }
+    }
+
+private:
+    Stage stage_;
+    unsigned outer_ = NUM_STAGES;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/// merges the shards of every thread so far and writes the counters and stage histograms to os
+void report(std::ostream &os);
+
+}   // namespace stats
+
+}   // namespace immulator
+
+#endif //IMMULATOR_STATS_H
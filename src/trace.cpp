@@ -0,0 +1,116 @@
+//
+// @author: jiahong
+// @date  : 28/10/26 10:10 AM
+//
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "trace.h"
+
+namespace immulator {
+
+namespace trace {
+
+namespace {
+
+// a busy thread records a few events per record; past this, new spans are dropped (whole) to bound memory
+constexpr std::size_t MAX_EVENTS_PER_THREAD = 1 << 22;
+
+struct Event {
+    const char *name;
+    std::int64_t ns;
+    char phase;
+};
+
+struct Buffer {
+    std::size_t tid;
+    std::vector<Event> events;
+    // spans begun while the buffer was full, whose end events have to be dropped as well
+    std::size_t suppressed = 0;
+    std::size_t dropped = 0;
+};
+
+std::string trace_filename;
+const auto epoch = std::chrono::steady_clock::now();
+std::mutex registry_mutex;
+// buffers outlive their threads so that write() can still read them
+std::vector<std::unique_ptr<Buffer>> registry;
+
+Buffer &
+buffer() {
+    thread_local Buffer *local = [] {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.emplace_back(new Buffer);
+        registry.back()->tid = registry.size() - 1;
+        registry.back()->events.reserve(1 << 12);
+        return registry.back().get();
+    }();
+    return *local;
+}
+
+}   // namespace
+
+bool recording = false;
+
+void
+enable(const std::string &filename) {
+    trace_filename = filename;
+    // the calling thread becomes thread 0
+    buffer();
+    recording = true;
+    std::atexit(write);
+}
+
+void
+event(const char *name, char phase) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    auto &local = buffer();
+    if (phase == 'B' && local.events.size() >= MAX_EVENTS_PER_THREAD) {
+        ++local.suppressed;
+        ++local.dropped;
+        return;
+    } else if (phase == 'E' && local.suppressed) {
+        --local.suppressed;
+        return;
+    }
+    local.events.push_back({name, ns, phase});
+}
+
+void
+write() {
+    if (!recording) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    std::ofstream out(trace_filename);
+    if (!out) {
+        std::cerr << "WARNING: cannot write trace to " << trace_filename << '\n';
+        return;
+    }
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool first = true;
+    std::size_t dropped = 0;
+    for (const auto &local : registry) {
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << local->tid
+            << ",\"args\":{\"name\":\"" << (local->tid ? "thread " + std::to_string(local->tid) : "main") << "\"}}";
+        first = false;
+        for (const auto &e : local->events) {
+            out << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"" << e.phase << "\",\"pid\":1,\"tid\":" << local->tid
+                << ",\"ts\":" << e.ns / 1000 << '.' << std::to_string(1000 + e.ns % 1000).substr(1) << '}';
+        }
+        dropped += local->dropped;
+    }
+    out << "\n]}\n";
+    if (dropped) {
+        std::cerr << "WARNING: trace buffers were full, " << dropped << " span(s) were not recorded\n";
+    }
+}
+
+}   // namespace trace
+
+}   // namespace immulator
@@ -0,0 +1,61 @@
+//
+// @author: jiahong
+// @date  : 28/10/26 10:10 AM
+//
+
+#ifndef IMMULATOR_TRACE_H
+#define IMMULATOR_TRACE_H
+
+#include <cstdint>
+#include <string>
+
+namespace immulator {
+
+/// Opt-in (--trace) timeline of what every thread is doing, written as Chrome trace JSON (chrome://tracing,
+/// ui.perfetto.dev). Every thread appends begin/end events to its own buffer without any locking; the buffers are
+/// only read once all threads are done. While tracing is off, a span is a single test of a global flag.
+namespace trace {
+
+/// whether events are being recorded; only changed by enable(), before any other thread starts
+extern bool recording;
+
+/// starts recording; the trace is written to filename at exit
+void enable(const std::string &filename);
+
+/// appends a begin (phase 'B') or end ('E') event of name, which must be a string literal, to this thread's buffer
+void event(const char *name, char phase);
+
+/// A begin/end pair around its lifetime (or until end() is called)
+class Span {
+public:
+    explicit Span(const char *name) : name_(recording ? name : nullptr) {
+        if (name_) {
+            event(name_, 'B');
+        }
+    }
+
+    Span(const Span &) = delete;
+
+    Span &operator=(const Span &) = delete;
+
+    ~Span() { end(); }
+
+    void end() {
+        if (name_) {
+            event(name_, 'E');
+            name_ = nullptr;
+        }
+    }
+
+private:
+    const char *name_;
+};
+
+/// writes the events of every thread so far to the file given to enable()
+void write();
+
+}   // namespace trace
+
+}   // namespace immulator
+
+#endif //IMMULATOR_TRACE_H
@@ -0,0 +1,323 @@
+//
+// @author: jiahong
+// @date  : 20/10/26 3:48 PM
+//
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <system_error>
+#include "uring.h"
+
+namespace immulator {
+
+namespace {
+
+int
+io_uring_setup(unsigned entries, io_uring_params *params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int
+io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int
+io_uring_register(int ring_fd, unsigned opcode, const void *arg, unsigned nr_args) {
+    return static_cast<int>(::syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args));
+}
+
+constexpr std::size_t BUFFER_ALIGNMENT = 4096;
+
+}   // namespace
+
+UringSink::UringSink(int fd, bool owned, unsigned depth) : fd_(fd), owned_(owned), depth_(depth) {}
+
+UringSink::~UringSink() {
+    if (!closed_ && ring_fd_ >= 0) {
+        try {
+            close();
+        } catch (const std::exception &e) {
+            std::cerr << "WARNING: failed to flush output: " << e.what() << '\n';
+        }
+    }
+    release_ring();
+    for (auto &buffer : buffers_) {
+        std::free(buffer.data);
+    }
+}
+
+void
+UringSink::release_ring() {
+    if (sqes_) {
+        ::munmap(sqes_, sqes_size_);
+        sqes_ = nullptr;
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_) {
+        ::munmap(cq_ring_, cq_ring_size_);
+    }
+    cq_ring_ = nullptr;
+    if (sq_ring_) {
+        ::munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = nullptr;
+    }
+    if (ring_fd_ >= 0) {
+        ::close(ring_fd_);
+        ring_fd_ = -1;
+    }
+}
+
+bool
+UringSink::supports_write() const {
+    // kernels older than 5.6 know neither the probe nor IORING_OP_WRITE, and refuse both with EINVAL
+    std::vector<unsigned long long> storage(
+            (sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op)) / sizeof(unsigned long long) + 1);
+    auto probe = reinterpret_cast<io_uring_probe *>(storage.data());
+    if (io_uring_register(ring_fd_, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0) {
+        return false;
+    }
+    return IORING_OP_WRITE < probe->ops_len && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+}
+
+bool
+UringSink::init() {
+    io_uring_params params{};
+    ring_fd_ = io_uring_setup(depth_, &params);
+    if (ring_fd_ < 0) {
+        return false;
+    }
+    if (!supports_write()) {
+        release_ring();
+        return false;
+    }
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        sq_ring_ = nullptr;
+        release_ring();
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            cq_ring_ = nullptr;
+            release_ring();
+            return false;
+        }
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ring_fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+        sqes_ = nullptr;
+        release_ring();
+        return false;
+    }
+
+    auto sq = static_cast<char *>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    auto cq = static_cast<char *>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = cq + params.cq_off.cqes;
+
+    // write at explicit offsets, starting wherever the descriptor currently is
+    auto pos = ::lseek(fd_, 0, SEEK_CUR);
+    offset_ = pos < 0 ? 0 : static_cast<unsigned long long>(pos);
+    return true;
+}
+
+void
+UringSink::allocate_buffers(std::size_t size) {
+    buffer_size_ = size;
+    buffers_.resize(depth_);
+    std::vector<iovec> iov;
+    for (std::size_t i = 0; i < buffers_.size(); ++i) {
+        void *data = nullptr;
+        if (::posix_memalign(&data, BUFFER_ALIGNMENT, size)) {
+            throw std::bad_alloc();
+        }
+        buffers_[i].data = static_cast<char *>(data);
+        iov.push_back({data, size});
+        free_.push_back(i);
+    }
+    // registration pins the buffers; it fails under a low RLIMIT_MEMLOCK, in which case plain WRITEs are used
+    registered_ = io_uring_register(ring_fd_, IORING_REGISTER_BUFFERS, iov.data(),
+                                    static_cast<unsigned>(iov.size())) == 0;
+}
+
+char *
+UringSink::next_buffer(std::size_t size) {
+    if (buffers_.empty()) {
+        allocate_buffers(size);
+    }
+    while (free_.empty()) {
+        reap(true);
+    }
+    auto index = free_.front();
+    free_.pop_front();
+    return buffers_[index].data;
+}
+
+std::size_t
+UringSink::buffer_index(const char *data) const {
+    for (std::size_t i = 0; i < buffers_.size(); ++i) {
+        if (data >= buffers_[i].data && data < buffers_[i].data + buffer_size_) {
+            return i;
+        }
+    }
+    return buffers_.size();
+}
+
+void
+UringSink::write(const char *data, std::size_t size) {
+    auto index = buffer_index(data);
+    if (index < buffers_.size()) {
+        // one of the lent buffers: queue it as is
+        submit(index, data, size, offset_);
+        offset_ += size;
+        return;
+    }
+    // someone else's memory (e.g. a compressed block): stage it through our buffers
+    while (size) {
+        char *buffer = next_buffer(buffer_size_ ? buffer_size_ : BufferedWriter::DEFAULT_BLOCK_SIZE);
+        auto chunk = std::min(size, buffer_size_);
+        std::memcpy(buffer, data, chunk);
+        submit(buffer_index(buffer), buffer, chunk, offset_);
+        offset_ += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void
+UringSink::submit(std::size_t index, const char *data, std::size_t size, unsigned long long offset) {
+    auto &buffer = buffers_[index];
+    if (!buffer.in_flight) {
+        buffer.in_flight = true;
+        ++in_flight_;
+    }
+    buffer.pending = data;
+    buffer.remaining = size;
+    buffer.offset = offset;
+
+    // at most depth_ buffers are ever in flight, so the submission queue cannot be full here
+    auto tail = *sq_tail_;
+    auto slot = tail & *sq_mask_;
+    auto sqe = static_cast<io_uring_sqe *>(sqes_) + slot;
+    *sqe = io_uring_sqe{};
+    sqe->opcode = registered_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = fd_;
+    sqe->addr = reinterpret_cast<unsigned long long>(data);
+    sqe->len = static_cast<unsigned>(size);
+    sqe->off = offset;
+    sqe->user_data = index;
+    if (registered_) {
+        sqe->buf_index = static_cast<unsigned short>(index);
+    }
+    sq_array_[slot] = slot;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+    while (io_uring_enter(ring_fd_, 1, 0, 0) < 0) {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            throw std::system_error(errno, std::generic_category(), "io_uring_enter failed");
+        }
+        reap(false);
+    }
+}
+
+void
+UringSink::reap(bool wait) {
+    if (!in_flight_) {
+        return;
+    }
+    auto head = __atomic_load_n(cq_head_, __ATOMIC_RELAXED);
+    if (wait && head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        while (io_uring_enter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS) < 0) {
+            if (errno != EINTR) {
+                throw std::system_error(errno, std::generic_category(), "io_uring_enter failed");
+            }
+        }
+    }
+    std::vector<std::size_t> resubmit;
+    for (auto tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE); head != tail; ++head) {
+        auto cqe = static_cast<io_uring_cqe *>(cqes_) + (head & *cq_mask_);
+        auto index = static_cast<std::size_t>(cqe->user_data);
+        auto res = cqe->res;
+        if (res < 0 && res != -EINTR && res != -EAGAIN) {
+            __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+            throw std::system_error(-res, std::generic_category(), "io_uring write failed");
+        }
+        auto &buffer = buffers_[index];
+        if (res == 0 && buffer.remaining) {
+            // nothing written and no error: resubmitting would spin forever
+            __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+            throw std::system_error(EIO, std::generic_category(), "io_uring write failed (short write)");
+        }
+        auto written = static_cast<std::size_t>(std::max(res, 0));
+        buffer.pending += written;
+        buffer.remaining -= written;
+        buffer.offset += written;
+        if (buffer.remaining) {
+            resubmit.push_back(index);
+        } else {
+            buffer.in_flight = false;
+            --in_flight_;
+            free_.push_back(index);
+        }
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    for (auto index : resubmit) {
+        auto &buffer = buffers_[index];
+        submit(index, buffer.pending, buffer.remaining, buffer.offset);
+    }
+}
+
+void
+UringSink::close() {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    while (in_flight_) {
+        reap(true);
+    }
+    if (owned_) {
+        ::close(fd_);
+    } else {
+        // leave the descriptor where a sequential writer would have
+        ::lseek(fd_, static_cast<off_t>(offset_), SEEK_SET);
+    }
+}
+
+std::unique_ptr<OutputSink>
+make_uring_sink(int fd, bool owned, unsigned depth) {
+    struct stat st{};
+    // pipes and terminals have no offsets to write at, keep them on the ordered write(2) path
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        std::unique_ptr<UringSink> sink(new UringSink(fd, owned, depth));
+        if (sink->init()) {
+            return sink;
+        }
+    }
+    return std::make_unique<FileSink>(fd, owned);
+}
+
+}   // namespace immulator
@@ -0,0 +1,105 @@
+//
+// @author: jiahong
+// @date  : 20/10/26 3:48 PM
+//
+
+#ifndef IMMULATOR_URING_H
+#define IMMULATOR_URING_H
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include "writer.h"
+
+namespace immulator {
+
+/// Asynchronous file sink on top of Linux io_uring (raw system calls, no liburing needed). It lends the buffered
+/// writer a small set of registered buffers, so a full block is queued as a WRITE_FIXED at its file offset and the
+/// generator carries on formatting into the next buffer while the kernel writes the previous ones.
+/// Use make_uring_sink() to construct one: it falls back to a FileSink when io_uring cannot be used.
+class UringSink : public OutputSink {
+public:
+    static constexpr unsigned DEFAULT_DEPTH = 4;
+
+    ~UringSink() override;
+
+    void write(const char *data, std::size_t size) override;
+
+    void close() override;
+
+    char *next_buffer(std::size_t size) override;
+
+private:
+    friend std::unique_ptr<OutputSink> make_uring_sink(int fd, bool owned, unsigned depth);
+
+    UringSink(int fd, bool owned, unsigned depth);
+
+    /// sets up the ring, returns false (and leaves this sink unusable) if the kernel refuses
+    /// \note a failed init() releases the ring but leaves fd_ open, for the FileSink fallback
+    bool init();
+
+    /// whether the kernel offers IORING_OP_WRITE (5.6 and later)
+    bool supports_write() const;
+
+    /// unmaps the rings and closes the ring descriptor; fd_ stays open
+    void release_ring();
+
+    void allocate_buffers(std::size_t size);
+
+    void submit(std::size_t index, const char *data, std::size_t size, unsigned long long offset);
+
+    /// processes completions, waiting for at least one when wait is true
+    void reap(bool wait);
+
+    /// index of the lent buffer data points into, or buffers_.size() if it is not one of ours
+    std::size_t buffer_index(const char *data) const;
+
+private:
+    struct Buffer {
+        char *data = nullptr;
+        // bytes still to be written, and where they go (partial writes are resubmitted)
+        const char *pending = nullptr;
+        std::size_t remaining = 0;
+        unsigned long long offset = 0;
+        bool in_flight = false;
+    };
+
+    int fd_;
+    bool owned_;
+    unsigned depth_;
+    int ring_fd_ = -1;
+    unsigned long long offset_ = 0;
+
+    void *sq_ring_ = nullptr;
+    std::size_t sq_ring_size_ = 0;
+    void *cq_ring_ = nullptr;
+    std::size_t cq_ring_size_ = 0;
+    void *sqes_ = nullptr;
+    std::size_t sqes_size_ = 0;
+
+    unsigned *sq_head_ = nullptr;
+    unsigned *sq_tail_ = nullptr;
+    unsigned *sq_mask_ = nullptr;
+    unsigned *sq_array_ = nullptr;
+    unsigned *cq_head_ = nullptr;
+    unsigned *cq_tail_ = nullptr;
+    unsigned *cq_mask_ = nullptr;
+    void *cqes_ = nullptr;
+
+    std::vector<Buffer> buffers_;
+    std::size_t buffer_size_ = 0;
+    bool registered_ = false;
+    std::deque<std::size_t> free_;
+    std::size_t in_flight_ = 0;
+    bool closed_ = false;
+};
+
+/// \param fd descriptor to write to
+/// \param owned close fd once the sink is closed
+/// \param depth number of buffers that may be in flight at once
+/// \return an io_uring backed sink, or a plain FileSink if io_uring is unavailable or fd is not a regular file
+std::unique_ptr<OutputSink> make_uring_sink(int fd, bool owned, unsigned depth = UringSink::DEFAULT_DEPTH);
+
+}   // namespace immulator
+
+#endif //IMMULATOR_URING_H
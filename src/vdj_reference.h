@@ -0,0 +1,555 @@
+//
+// @author: jiahong
+// @date  : 29/10/26 11:15 AM
+//
+// Frozen copy of the samplers in vdj.h, germline_factory.h and germline_configuration.h as they were before any
+// sampler optimisation, without the stats/trace/perf hooks. immulator_equivalence draws large samples from this
+// engine and from the live one and tests that their distributions agree, so a faster dcutter, jcutter,
+// palindromic or nearest_key has to produce the same repertoires. Do not optimise or otherwise change this file.
+//
+
+#ifndef IMMULATOR_VDJ_REFERENCE_H
+#define IMMULATOR_VDJ_REFERENCE_H
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include "germline.h"
+#include "germline_configuration.h"
+#include "germline_factory.h"
+#include "immutils.h"
+#include "recombination.h"
+#include "vdj.h"
+
+namespace immulator {
+
+namespace reference {
+
+// calls between these templates are qualified: unqualified, argument dependent lookup would also find the live
+// versions in namespace immulator
+
+template<typename Gen>
+immulator::optional<immulator::Recombination>
+vdj_recombination(const Germline &vgerm, const Germline &dgerm, const Germline &jgerm, Gen &generator,
+                  bool prod = true, bool multiple = true);
+
+template<typename Gen>
+immulator::optional<std::pair<immulator::Germline::size_type, immulator::Germline::size_type>>
+vcutter(const Germline &vgerm, Gen &generator);
+
+template<typename Gen>
+std::tuple<immulator::Germline::size_type, immulator::Germline::size_type, bool>
+dcutter(const Germline &dgerm, Gen &generator, const std::string &rem, bool check = true);
+
+template<typename Gen>
+immulator::optional<std::tuple<immulator::Germline::size_type, immulator::Germline::size_type,
+        immulator::Germline::size_type, bool>>
+jcutter(const Germline &jgerm, Gen &generator, const std::string &rem,
+        std::string::size_type extras, bool check);
+
+template<typename Gen>
+immulator::optional<std::string>
+palindromic(std::string::size_type n, Gen &generator, const std::string &rem, bool productive = true);
+
+template<typename Gen>
+std::string
+random_nts(std::string::size_type n, Gen &generator, const std::string &rem, bool productive = true);
+
+/// GermlineConfiguration::next_roll()
+template<typename Gen>
+std::string
+next_roll(const GermlineConfiguration &gcfg, Gen &generator) {
+    if (gcfg.distribution().empty()) {
+        return "";
+    }
+    std::uniform_real_distribution<double> dist(0, 1);
+    auto roll = dist(generator);
+    // nearest_key()
+    double distance = std::numeric_limits<double>::infinity();
+    std::vector<std::string> best_selection;
+    for (auto &keypair : gcfg.distribution()) {
+        auto d = std::abs(roll - keypair.first);
+        if (d <= distance) {
+            distance = d;
+            best_selection.push_back(keypair.second);
+        } else {
+            break;
+        }
+    }
+    assert(!best_selection.empty());
+    if (best_selection.size() == 1) {
+        return best_selection.front();
+    } else {
+        std::uniform_int_distribution<std::vector<std::string>::size_type> dst(0, best_selection.size() - 1);
+        return best_selection[dst(generator)];
+    }
+}
+
+/// GermlineFactory::operator()
+template<typename Gen>
+const Germline &
+draw(const GermlineFactory &pool, Gen &generator) {
+    const auto &germlines = pool.germlines();
+    auto query = reference::next_roll(pool.configuration(), generator);
+    std::vector<const Germline *> filtered_germlines;
+    if (!query.empty()) {
+        for (const auto &key : germlines) {
+            bool match;
+            if (query.find('*') != std::string::npos) {
+                match = key.name() == query;
+            } else if (query.find('-') != std::string::npos) {
+                match = key.gene_name() == query;
+            } else {
+                match = key.family_name() == query;
+            }
+            if (match) {
+                filtered_germlines.push_back(&key);
+            }
+        }
+    }
+    if (filtered_germlines.empty()) {
+        std::uniform_int_distribution<std::vector<Germline>::size_type> dist(0, germlines.size() - 1);
+        return germlines[dist(generator)];
+    } else {
+        std::uniform_int_distribution<std::vector<const Germline *>::size_type> dist(0,
+                                                                                     filtered_germlines.size() - 1);
+        return *filtered_germlines[dist(generator)];
+    }
+}
+
+/// Simulator::next_record(): draws V-D-J triples until one recombines
+template<typename Gen>
+immulator::Recombination
+recombine(const GermlineFactory &vpool, const GermlineFactory &dpool, const GermlineFactory &jpool, Gen &generator) {
+    for (;;) {
+        const auto &v = reference::draw(vpool, generator);
+        const auto &d = reference::draw(dpool, generator);
+        const auto &j = reference::draw(jpool, generator);
+        auto recombined = reference::vdj_recombination(v, d, j, generator);
+        if (recombined) {
+            return *recombined;
+        }
+    }
+}
+
+template<typename Gen>
+immulator::optional<immulator::Recombination>
+vdj_recombination(const Germline &vgerm, const Germline &dgerm, const Germline &jgerm, Gen &mersenne, bool prod,
+                  bool multiple) {
+    using size_type = immulator::Germline::size_type;
+    static constexpr std::size_t MAX_ATTEMPTS = 100'000;
+    auto v = reference::vcutter(vgerm, mersenne);
+    std::size_t attempts_insertion = 0;
+    immulator::Recombination rec;
+    std::uniform_int_distribution<std::string::size_type> palin_rand(0, 8);
+    std::uniform_int_distribution<std::string::size_type> ins_rand(0, 5);
+
+    if (v) {
+        rec.v = &vgerm;
+        rec.d = &dgerm;
+        rec.j = &jgerm;
+        rec.v_length = v->first;
+        bool d_prod = false;
+        size_type d_front_cut;
+        // starts AFTER Cys (and convert to 1-index)
+        size_type cdr3_start_pos = v->second + 3 + 1;
+        std::size_t attempt_d = 0;
+        auto p1 = reference::palindromic(palin_rand(mersenne), mersenne, rec.remainder(), prod);
+        while (!p1 && prod && ++attempts_insertion < MAX_ATTEMPTS) {
+            p1 = reference::palindromic(palin_rand(mersenne), mersenne, rec.remainder(), prod);
+        }
+        rec.junction += *p1;
+        auto n1 = reference::random_nts(ins_rand(mersenne), mersenne, rec.remainder(), prod);
+        rec.junction += n1;
+        auto p2 = reference::palindromic(palin_rand(mersenne), mersenne, rec.remainder(), prod);
+        while (!p2 && prod && ++attempts_insertion < MAX_ATTEMPTS) {
+            p2 = reference::palindromic(palin_rand(mersenne), mersenne, rec.remainder(), prod);
+        }
+        rec.junction += *p2;
+        do {
+            std::tie(d_front_cut, rec.d_length, d_prod) = reference::dcutter(dgerm, mersenne,
+                                                                              rec.remainder(), prod);
+            ++attempt_d;
+        } while (!d_prod && prod && attempt_d < MAX_ATTEMPTS);
+        rec.np1_length = rec.junction.size();
+        rec.d_5p_del = d_front_cut;
+        rec.d_3p_del = dgerm.size() - d_front_cut - rec.d_length;
+        rec.junction.append(dgerm.sequence(), d_front_cut, rec.d_length);
+        auto p3 = reference::palindromic(palin_rand(mersenne), mersenne, rec.remainder(), prod);
+        while (!p3 && prod && ++attempts_insertion < MAX_ATTEMPTS) {
+            p3 = reference::palindromic(palin_rand(mersenne), mersenne, rec.remainder(), prod);
+        }
+        rec.junction += *p3;
+        auto n2 = reference::random_nts(ins_rand(mersenne), mersenne, rec.remainder(), prod);
+        rec.junction += n2;
+        auto p4 = reference::palindromic(palin_rand(mersenne), mersenne, rec.remainder(), prod);
+        while (!p4 && prod && ++attempts_insertion < MAX_ATTEMPTS) {
+            p4 = reference::palindromic(ins_rand(mersenne), mersenne, rec.remainder(), prod);
+        }
+        rec.junction += *p4;
+        auto current_incomplete_cdr3_length = (v->first - cdr3_start_pos + 1) + p1->size() + n1.size() + p2->size()
+                                              + rec.d_length + p3->size() + n2.size() + p4->size();
+        std::size_t attempt_j = 0;
+        size_type fwgxg_conserved_index;
+        auto jtry = reference::jcutter(jgerm, mersenne, rec.remainder(),
+                                       (3 - (current_incomplete_cdr3_length % 3)) % 3,
+                                       prod);
+
+        if (jtry) {
+            bool j_prod = false;
+            std::tie(rec.j_start, rec.j_length, fwgxg_conserved_index, j_prod) = *jtry;
+            while (!j_prod && prod && attempt_j++ < MAX_ATTEMPTS) {
+                jtry = reference::jcutter(jgerm, mersenne,
+                                          rec.remainder(),
+                                          (3 - (current_incomplete_cdr3_length % 3)) % 3,
+                                          prod);
+                if (!jtry) {
+                    // fail to find J gene anchor - fail immediately
+                    return {};
+                }
+                std::tie(rec.j_start, rec.j_length, fwgxg_conserved_index, j_prod) = *jtry;
+            }
+            rec.cdr3_start = cdr3_start_pos;
+            rec.cdr3_end = rec.v_length + rec.junction.size() + fwgxg_conserved_index;
+            if (multiple && (rec.size() % 3)) {
+                // drop the trailing partial codon, eating into the junction only if J is shorter than it
+                auto excess = rec.size() % 3;
+                auto from_j = std::min(excess, rec.j_length);
+                rec.j_length -= from_j;
+                rec.junction.resize(rec.junction.size() - (excess - from_j));
+                assert(rec.size() % 3 == 0);
+            }
+            return rec;
+        } else {
+            // fail to find J gene anchor [FW]G.G region
+            return {};
+        }
+
+    } else {
+        // fail to find anchor Cys region
+        return {};
+    }
+}
+
+///
+/// \tparam Gen
+/// \param vgerm
+/// \param generator
+/// \return  std::pair<Length of the trimmed V Germline, NT index of last occurring Cys> if Cys can be found.
+template<typename Gen>
+immulator::optional<std::pair<immulator::Germline::size_type, immulator::Germline::size_type>>
+vcutter(const Germline &vgerm, Gen &generator) {
+    using size_type = immulator::Germline::size_type;
+    auto aa = immulator::translate(vgerm.sequence());
+    size_type cys;
+    if ((cys = aa.find_last_of('C')) == std::string::npos) {
+        return {};
+    } else {
+        size_type nuc_index = cys * 3;
+
+        // V germlines are usually > 200 (actually, >250)
+        if (nuc_index < 200) {
+            return {};
+        }
+
+        // remaining nucleotides that we can cut
+        size_type nt_rem = vgerm.size() - (nuc_index + 3) - 1;
+
+        // we can cut anywhere between 0 - nt_rem nucleotides
+        std::uniform_int_distribution<size_type> idist(0, nt_rem);
+        size_type final_length = vgerm.size() - idist(generator);
+        return std::make_pair(final_length, nuc_index);
+    }
+}
+
+/// \return std::tuple<front cut, length of the trimmed D, productive>
+template<typename Gen>
+std::tuple<immulator::Germline::size_type, immulator::Germline::size_type, bool>
+dcutter(const Germline &dgerm, Gen &generator, const std::string &rem, bool check) {
+    using size_type = immulator::Germline::size_type;
+    constexpr std::size_t MAX_ATTEMPTS = 100'000;
+
+    bool productive = true;
+
+    /* ---------------------------------------------------------------------------- *
+     *          Determine how to cut the front nt seqs from D Germline              *
+     *                                                                              *
+     * ---------------------------------------------------------------------------- */
+    constexpr double FRONT_CUT_PERC = 30.0 / 100;
+
+    auto max_front_cut_size = static_cast<size_type>(std::ceil(FRONT_CUT_PERC * dgerm.size()));
+    std::uniform_int_distribution<size_type> front_idist(0, max_front_cut_size);
+
+    // cut front of D gene by "front_cut" much
+    auto front_cut = front_idist(generator);
+    if (check) {
+        auto aa = immulator::translate(rem + dgerm.substr(front_cut));
+        std::size_t attempt = 0;
+        for (; attempt < MAX_ATTEMPTS && aa.find('*') != std::string::npos; ++attempt) {
+            front_cut = front_idist(generator);
+            aa = immulator::translate(rem + dgerm.substr(front_cut));
+        }
+        if (attempt == MAX_ATTEMPTS) {
+            productive = false;
+        }
+    }
+
+
+    /* ---------------------------------------------------------------------------- *
+     *          Determine how to cut the end in nt seqs from D Germline             *
+     *                                                                              *
+     * ---------------------------------------------------------------------------- */
+
+    constexpr double BACK_CUT_PERC = 30.0 / 100;
+    auto max_back_cut_size = static_cast<size_type>(std::ceil(BACK_CUT_PERC * dgerm.size()));
+    std::uniform_int_distribution<size_type> back_idist(0, max_back_cut_size);
+
+    // cut back of D gene by "back_cut" much
+    auto back_cut = back_idist(generator);
+    return std::make_tuple(front_cut, dgerm.size() - front_cut - back_cut, productive);
+}
+
+/// \return std::tuple<front cut, length of the trimmed J, conserved FR4 index within the trimmed J, productive>
+/// if the FR4 anchor can be found.
+template<typename Gen>
+immulator::optional<std::tuple<immulator::Germline::size_type, immulator::Germline::size_type,
+        immulator::Germline::size_type, bool>>
+jcutter(const Germline &jgerm, Gen &generator, const std::string &rem,
+        std::string::size_type extras, bool check) {
+    assert(extras >= 0 && extras <= 2 && "Extras is expected to be an integer between 0 and 2 inclusive");
+    using size_type = immulator::Germline::size_type;
+    constexpr std::size_t MAX_ATTEMPTS = 100'000;
+
+    bool productive = true;
+
+    /* ------------------------------------------------------------------------------ *
+     *                          Find consensus FR4 [FW]G.G                            *
+     *                                                                                *
+     * ------------------------------------------------------------------------------ */
+
+    static std::unordered_map<std::string, std::unordered_map<std::string, std::string>> FR4_CONSENSUS_AA = {
+            {
+                    "H.SAPIENS", {
+                                         {"hv", "WGQGTXVTVSS"},
+                                         {"kv", "FGXGTKLEIK"},
+                                         {"lv", "FGXGTKLTVL"}
+                                 }
+            },
+    };
+    static std::unordered_map<std::string, std::unordered_map<std::string, std::string>> FR4_CONSENSUS_DNA = {
+            {
+                    "H.SAPIENS", {
+                                         {"hv", "TGGGGCCAGGGCACCNNNGTGACCGTGAGCAGC"},
+                                         {"kv", "TTTGGCCAGGGGACCAAGCTGGAGATCAAA"},
+                                         {"lv", "TTCGGCGGAGGGACCAAGCTGACCGTCCTA"}
+                                 }
+            },
+    };
+    // first, find all the matching positions of this pattern
+    auto jaa = immulator::translate(jgerm.sequence());
+
+    // try getting AA position first
+    std::string::size_type start, end;
+    size_type orf = 0, used_orf = 0;
+    double best_score = 0;
+
+    for (; orf < 3; ++orf) {
+        double score;
+        std::string::size_type current_start, current_end;
+        std::tie(score, current_start, current_end) = immulator::local_align(jaa, FR4_CONSENSUS_AA["H.SAPIENS"]["hv"],
+                                                                             -5, -5,
+                                                                             blosum62());
+        if (score > best_score) {
+            start = current_start;
+            end = current_end;
+            best_score = score;
+            used_orf = orf;
+        }
+        jaa = immulator::translate(jgerm.substr(orf + 1));
+    }
+    if (start < end) {
+        // convert to NT start position
+        start = start * 3 + used_orf;
+        end = end * 3 + used_orf;
+    } else {
+        // try AA position
+        std::tie(std::ignore, start, end) = immulator::local_align(jgerm.sequence(),
+                                                                   FR4_CONSENSUS_DNA["H.SAPIENS"]["hv"], -5, -5,
+                                                                   nt_scoring_matrix());
+        if (start < end) {
+            return {};
+        }
+    }
+
+    /* -------------------------------------------------------------------------------- *
+     *                       Determine how to cut the front nt seqs                     *
+     *                                                                                  *
+     * -------------------------------------------------------------------------------- */
+    constexpr double FRONT_CUT_PERC = 30.0 / 100;
+    auto max_front_cut_size = static_cast<size_type>(std::ceil(FRONT_CUT_PERC * jgerm.size()));
+    std::uniform_int_distribution<size_type> front_idist(0, std::min(max_front_cut_size, start));
+
+    auto front_cut = front_idist(generator);
+    // to maintain the V-J frame, FWGXG index - extras % 3 should be 0
+    if (front_cut < start) {
+        auto offset =  (start - front_cut - extras) % 3;
+        auto offset_by = (3 - offset) % 3;
+        // if we can afford to trim the front or if we CAN'T extend the back, use the front
+        if (offset_by <= front_cut && (immulator::coin_flip(generator) || front_cut + offset > start)) {
+            front_cut -= offset_by;
+        } else {
+            front_cut += offset;
+        }
+    } else {
+        assert(front_cut == start && extras <= start);
+        // scale back to allow extras to consume the "scaled" back nt
+        front_cut -= extras;
+    }
+
+    if (check) {
+        auto aa = immulator::translate(rem + jgerm.substr(front_cut));
+        std::size_t attempt = 0;
+        for (; attempt < MAX_ATTEMPTS && aa.find('*') != std::string::npos; ++attempt) {
+            front_cut = front_idist(generator);
+            if (front_cut < start) {
+                auto offset =  (start - front_cut - extras) % 3;
+                auto offset_by = (3 - offset) % 3;
+                // 50% chance of offsetting either from the front or back, but if adding the offset to the back will
+                // cause a trim on the conserved anchor position (start), then force offsetting to happen from the front
+                // if offsetting from the front will cause a negative index (offset > front_cut), use the back as offset
+                // regardless of whether or not we lose the conserved region
+                if (offset_by <= front_cut && (immulator::coin_flip(generator) || front_cut + offset > start)) {
+                    front_cut -= offset_by;
+                } else {
+                    front_cut += offset;
+                }
+            } else {
+                assert(front_cut == start && extras <= start);
+                front_cut -= extras;
+            }
+            aa = immulator::translate(rem + jgerm.substr(front_cut));
+        }
+        if (attempt == MAX_ATTEMPTS) {
+            productive = false;
+        }
+    }
+    assert(front_cut > start || (start - front_cut - extras) % 3 == 0);
+    /* -------------------------------------------------------------------------------- *
+     *                       Determine how to cut the back nt seqs                      *
+     *                                                                                  *
+     * -------------------------------------------------------------------------------- */
+    constexpr double BACK_CUT_PERC = 0 / 100;
+    auto max_back_cut_size = static_cast<size_type>(std::ceil(BACK_CUT_PERC * jgerm.size()));
+    std::uniform_int_distribution<size_type> back_idist(0, max_back_cut_size);
+
+    auto back_cut = back_idist(generator);
+    // when front_cut > start, it means we compensated V-J frame with additional cut INTO the conserved region,
+    // so naturally CDR3 starts as early as 0
+    return std::make_tuple(front_cut, jgerm.size() - back_cut - front_cut,
+                           front_cut <= start ? start - front_cut : 0, productive);
+}
+
+template<typename Gen>
+immulator::optional<std::string>
+palindromic(std::string::size_type n, Gen &generator, const std::string &rem, bool productive) {
+    assert(rem.size() <= 2);
+    constexpr static char NTS[] = {'A', 'C', 'G', 'T'};
+    constexpr static std::size_t MAX_ATTEMPTS = 100'000;
+    static std::unordered_map<char, char> COMPLEMENT_NT = {
+            {'A', 'T'}, {'T', 'A'}, {'C', 'G'}, {'G', 'C'}
+    };
+    std::string nt_seq;
+
+    if (!productive) {
+        std::uniform_int_distribution<std::string::size_type> idist(0, 3);      // 0 to len(NTS) - 1
+        // first half
+        for (auto i = 0; i < n / 2; ++i) {
+            nt_seq.push_back(NTS[idist(generator)]);
+        }
+
+        // the middle nucleotide (if n is odd)
+        if (n % 2) {
+            nt_seq.push_back(NTS[idist(generator)]);
+        }
+
+        // the remaining (second) half
+        for (auto i = 0; i < n / 2; ++i) {
+            nt_seq.push_back(COMPLEMENT_NT[nt_seq[n / 2 - i - 1]]);
+        }
+        return immulator::join_string(nt_seq.cbegin(), nt_seq.cend(), "");
+    } else {
+        bool is_productive = false;
+        std::size_t attempts = 0;
+        std::string aa_seq;
+        do {
+            std::string current_codon = rem;
+            nt_seq.clear();
+            // first half
+            for (auto i = 0; i < n / 2; ++i) {
+                auto allowed_nt = immulator::allowed_nts(current_codon);
+                std::uniform_int_distribution<std::string::size_type> idist(0, allowed_nt.size() - 1);
+                char nt = allowed_nt[idist(generator)];
+                nt_seq.push_back(nt);
+                current_codon += nt;
+                current_codon = current_codon.size() == 3 ? "" : current_codon;
+            }
+
+            // middle nucleotide (when n is odd)
+            if (n % 2) {
+                auto allowed_nt = immulator::allowed_nts(current_codon);
+                std::uniform_int_distribution<std::string::size_type> idist(0, allowed_nt.size() - 1);
+                char nt = allowed_nt[idist(generator)];
+                nt_seq.push_back(nt);
+                current_codon += nt;
+                current_codon = current_codon.size() == 3 ? "" : current_codon;
+            }
+
+            for (auto i = 0; i < n / 2; ++i) {
+                nt_seq.push_back(COMPLEMENT_NT[nt_seq[n / 2 - i - 1]]);
+            }
+            aa_seq = immulator::join_string(nt_seq.cbegin(), nt_seq.cend(), "");
+            is_productive = immulator::translate(aa_seq).find('*') == std::string::npos;
+        } while (!is_productive && ++attempts < MAX_ATTEMPTS);
+        return is_productive ? aa_seq : immulator::optional<std::string>();
+    }
+
+}
+
+
+template<typename Gen>
+std::string
+random_nts(std::string::size_type n, Gen &generator, const std::string &rem, bool productive) {
+    assert(rem.size() <= 2);
+    constexpr static char NTS[] = {'A', 'C', 'G', 'T'};
+
+    std::string nt_seq;
+
+    if (!productive) {
+        std::uniform_int_distribution<std::string::size_type> idist(0, 3);
+        for (auto i = 0; i < n; ++i) {
+            nt_seq += NTS[idist(generator)];
+        }
+    } else {
+        std::string current_codon = rem;
+        for (auto i = 0; i < n; ++i) {
+            auto allowed_nt = immulator::allowed_nts(current_codon);
+            std::uniform_int_distribution<std::string::size_type> idist(0, allowed_nt.size() - 1);
+            char nt = allowed_nt[idist(generator)];
+            nt_seq += nt;
+            current_codon += nt;
+            current_codon = current_codon.size() == 3 ? "" : current_codon;
+        }
+    }
+    return nt_seq;
+}
+
+}   // namespace reference
+
+}   // namespace immulator
+
+#endif //IMMULATOR_VDJ_REFERENCE_H
@@ -0,0 +1,333 @@
+//
+// @author: jiahong
+// @date  : 19/10/26 9:12 AM
+//
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <system_error>
+#include "writer.h"
+#include "immutils.h"
+#include "probes.h"
+#include "trace.h"
+
+namespace immulator {
+
+int
+open_output_file(const std::string &filename) {
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "cannot open " + filename);
+    }
+    return fd;
+}
+
+FileSink::FileSink(const std::string &filename) : fd_(open_output_file(filename)), owned_(true) {}
+
+FileSink::~FileSink() {
+    if (owned_ && fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+void
+FileSink::write(const char *data, std::size_t size) {
+    while (size) {
+        auto written = ::write(fd_, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "write failed");
+        } else if (written == 0) {
+            throw std::system_error(EIO, std::generic_category(), "write failed (short write)");
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+}
+
+void
+FileSink::close() {
+    if (owned_ && fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+BufferedWriter::BufferedWriter(std::unique_ptr<OutputSink> sink, std::size_t block_size) :
+        sink_(std::move(sink)), buffer_(sink_->next_buffer(block_size)), capacity_(block_size) {
+    if (!buffer_) {
+        storage_.resize(block_size);
+        buffer_ = storage_.data();
+    }
+}
+
+BufferedWriter::~BufferedWriter() {
+    try {
+        close();
+    } catch (const std::exception &e) {
+        std::cerr << "WARNING: failed to flush output: " << e.what() << '\n';
+    }
+}
+
+void
+BufferedWriter::write_uint(unsigned long long value) {
+    // longest unsigned long long has 20 digits
+    if (capacity_ - used_ < 20) {
+        flush();
+    }
+    used_ += immulator::format_uint(buffer_ + used_, value);
+}
+
+void
+BufferedWriter::flush() {
+    if (used_) {
+        immulator::trace::Span span("flush");
+        IMMULATOR_PROBE1(batch_flushed, used_);
+        sink_->write(buffer_, used_);
+        used_ = 0;
+        if (storage_.empty()) {
+            buffer_ = sink_->next_buffer(capacity_);
+        }
+    }
+}
+
+void
+BufferedWriter::close() {
+    if (!closed_) {
+        closed_ = true;
+        flush();
+        sink_->close();
+    }
+}
+
+void
+BufferedWriter::write_slow(const char *data, std::size_t size) {
+    while (size) {
+        if (used_ == capacity_) {
+            flush();
+        }
+        auto chunk = std::min(size, capacity_ - used_);
+        std::memcpy(buffer_ + used_, data, chunk);
+        used_ += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void
+FastaWriter::write(std::size_t index, const immulator::Recombination &record) {
+    out_.put('>');
+    out_.write_uint(index);
+    out_.put('|');
+    out_.write(record.v->name());
+    out_.put(',');
+    out_.write(record.d->name());
+    out_.put(',');
+    out_.write(record.j->name());
+    out_.put('\n');
+    if (!line_width_) {
+        out_.write(record.v_data(), record.v_length);
+        out_.write(record.junction);
+        out_.write(record.j_data(), record.j_length);
+        out_.put('\n');
+    } else {
+        std::size_t column = 0;
+        write_wrapped(record.v_data(), record.v_length, column);
+        write_wrapped(record.junction.data(), record.junction.size(), column);
+        write_wrapped(record.j_data(), record.j_length, column);
+        if (column || !record.size()) {
+            out_.put('\n');
+        }
+    }
+}
+
+std::size_t
+FastaWriter::max_record_size(std::size_t name_size, std::size_t seq_size, std::size_t line_width) {
+    // '>' + index + '|' + names with their two commas + '\n', then the sequence lines
+    auto lines = line_width ? (seq_size + line_width - 1) / line_width : 1;
+    return 1 + 20 + 1 + name_size + 2 + 1 + seq_size + std::max<std::size_t>(lines, 1);
+}
+
+void
+FastaWriter::write_wrapped(const char *data, std::size_t size, std::size_t &column) {
+    while (size) {
+        auto chunk = std::min(size, line_width_ - column);
+        out_.write(data, chunk);
+        data += chunk;
+        size -= chunk;
+        column += chunk;
+        if (column == line_width_) {
+            out_.put('\n');
+            column = 0;
+        }
+    }
+}
+
+void
+ProteinFastaWriter::write(std::size_t index, const immulator::Recombination &record) {
+    nucleotides_.resize(record.size());
+    proteins_.resize(record.size() / 3 + 1);
+    std::memcpy(nucleotides_.data(), record.v_data(), record.v_length);
+    std::memcpy(nucleotides_.data() + record.v_length, record.junction.data(), record.junction.size());
+    std::memcpy(nucleotides_.data() + record.v_length + record.junction.size(), record.j_data(), record.j_length);
+    auto size = immulator::translate_codons(nucleotides_.data(), record.size(), proteins_.data());
+    write_record(index, record, proteins_.data(), size);
+}
+
+void
+ProteinFastaWriter::write_record(std::size_t index, const immulator::Recombination &record, const char *protein,
+                                 std::size_t size) {
+    out_.put('>');
+    out_.write_uint(index);
+    out_.put('|');
+    out_.write(record.v->name());
+    out_.put(',');
+    out_.write(record.d->name());
+    out_.put(',');
+    out_.write(record.j->name());
+    out_.put('\n');
+    if (!line_width_) {
+        out_.write(protein, size);
+        out_.put('\n');
+        return;
+    }
+    for (std::size_t k = 0; k < size; k += line_width_) {
+        out_.write(protein + k, std::min(line_width_, size - k));
+        out_.put('\n');
+    }
+    if (!size) {
+        out_.put('\n');
+    }
+}
+
+GatherFastaWriter::GatherFastaWriter(int fd, std::size_t arena_size) :
+        fd_(fd), arena_(arena_size), max_iov_(static_cast<std::size_t>(std::max(16L, ::sysconf(_SC_IOV_MAX)))) {
+    iov_.reserve(max_iov_);
+}
+
+GatherFastaWriter::~GatherFastaWriter() {
+    try {
+        flush();
+    } catch (const std::exception &e) {
+        std::cerr << "WARNING: failed to flush output: " << e.what() << '\n';
+    }
+}
+
+void
+GatherFastaWriter::write(std::size_t index, const immulator::Recombination &record) {
+    const auto &vname = record.v->name();
+    const auto &dname = record.d->name();
+    const auto &jname = record.j->name();
+    // '>' + 20 digits + '|' + names + 2 commas + 2 newlines, plus the junction
+    auto arena_needed = 25 + vname.size() + dname.size() + jname.size() + record.junction.size();
+    // header, V, junction, J, newline
+    if (arena_.size() - used_ < arena_needed || max_iov_ - iov_.size() < 5) {
+        flush();
+    }
+    if (arena_.size() < arena_needed) {
+        arena_.resize(arena_needed);
+    }
+    char header[21];
+    header[0] = '>';
+    copy(header, 1 + immulator::format_uint(header + 1, index));
+    copy("|", 1);
+    copy(vname.data(), vname.size());
+    copy(",", 1);
+    copy(dname.data(), dname.size());
+    copy(",", 1);
+    copy(jname.data(), jname.size());
+    copy("\n", 1);
+    refer(record.v_data(), record.v_length);
+    copy(record.junction.data(), record.junction.size());
+    refer(record.j_data(), record.j_length);
+    copy("\n", 1);
+}
+
+void
+GatherFastaWriter::flush() {
+    auto iov = iov_.data();
+    auto count = static_cast<int>(iov_.size());
+    while (count) {
+        auto written = ::writev(fd_, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "writev failed");
+        }
+        // skip whatever was fully written, then adjust the partially written slice (if any)
+        auto remaining = static_cast<std::size_t>(written);
+        while (count && remaining >= iov->iov_len) {
+            remaining -= iov->iov_len;
+            ++iov, --count;
+        }
+        if (count) {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + remaining;
+            iov->iov_len -= remaining;
+        }
+    }
+    iov_.clear();
+    used_ = 0;
+}
+
+void
+GatherFastaWriter::copy(const char *data, std::size_t size) {
+    if (!size) {
+        return;
+    }
+    char *dst = &arena_[used_];
+    std::memcpy(dst, data, size);
+    used_ += size;
+    if (!iov_.empty() && static_cast<char *>(iov_.back().iov_base) + iov_.back().iov_len == dst) {
+        iov_.back().iov_len += size;
+    } else {
+        iov_.push_back({dst, size});
+    }
+}
+
+void
+GatherFastaWriter::refer(const char *data, std::size_t size) {
+    if (size) {
+        iov_.push_back({const_cast<char *>(data), size});
+    }
+}
+
+constexpr const char ReferenceWriter::HEADER[];
+
+std::size_t
+ReferenceWriter::max_record_size(std::size_t name_size) {
+    // names with their two commas, then two positions and the newline
+    return name_size + 2 + 2 * (1 + 20) + 1;
+}
+
+std::size_t
+ReferenceWriter::record_size(const immulator::Recombination &record) {
+    char digits[20];
+    return record.v->name().size() + record.d->name().size() + record.j->name().size() + 3
+           + immulator::format_uint(digits, record.cdr3_start) + 1 + immulator::format_uint(digits, record.cdr3_end)
+           + 1;
+}
+
+void
+ReferenceWriter::write(std::size_t, const immulator::Recombination &record) {
+    if (!header_written_) {
+        header_written_ = true;
+        // the header need only be written once (on the first call)
+        out_.write(HEADER, sizeof(HEADER) - 1);
+    }
+    out_.write(record.v->name());
+    out_.put(',');
+    out_.write(record.d->name());
+    out_.put(',');
+    out_.write(record.j->name());
+    out_.put(',');
+    out_.write_uint(record.cdr3_start);
+    out_.put(',');
+    out_.write_uint(record.cdr3_end);
+    out_.put('\n');
+}
+
+}   // namespace immulator
@@ -0,0 +1,239 @@
+//
+// @author: jiahong
+// @date  : 19/10/26 9:12 AM
+//
+
+#ifndef IMMULATOR_WRITER_H
+#define IMMULATOR_WRITER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <sys/uio.h>
+#include "recombination.h"
+
+namespace immulator {
+
+/// Destination of fully formatted output blocks. Implementations receive large contiguous blocks and are
+/// expected to push each of them out with as few system calls as possible.
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+
+    virtual void write(const char *data, std::size_t size) = 0;
+
+    /// flushes anything the sink itself holds on to; called once, after the last write
+    virtual void close() {}
+
+    /// Sinks that keep blocks in flight after write() returns can lend the writer the buffers to format into.
+    /// Such a sink returns a buffer of at least size bytes here, and owns it again once it is passed to write().
+    /// \return nullptr (the default) when the writer should keep using its own buffer
+    virtual char *next_buffer(std::size_t /*size*/) { return nullptr; }
+};
+
+/// creates (or truncates) filename for writing
+/// \return the opened descriptor; throws std::system_error on failure
+int open_output_file(const std::string &filename);
+
+/// Plain file descriptor sink: a single write(2) per block (looping only on partial writes)
+class FileSink : public OutputSink {
+public:
+    /// wraps an already opened descriptor (e.g. STDOUT_FILENO); the descriptor is closed only if owned
+    explicit FileSink(int fd, bool owned = false) : fd_(fd), owned_(owned) {}
+
+    /// creates (or truncates) filename for writing
+    explicit FileSink(const std::string &filename);
+
+    ~FileSink() override;
+
+    void write(const char *data, std::size_t size) override;
+
+    void close() override;
+
+private:
+    int fd_;
+    bool owned_;
+};
+
+/// Formats into one large reusable buffer and hands it to the sink only when a whole block is full
+class BufferedWriter {
+public:
+    static constexpr std::size_t DEFAULT_BLOCK_SIZE = 4 << 20;
+
+    explicit BufferedWriter(std::unique_ptr<OutputSink> sink, std::size_t block_size = DEFAULT_BLOCK_SIZE);
+
+    BufferedWriter(const BufferedWriter &) = delete;
+
+    BufferedWriter &operator=(const BufferedWriter &) = delete;
+
+    ~BufferedWriter();
+
+    void write(const char *data, std::size_t size) {
+        if (size > capacity_ - used_) {
+            write_slow(data, size);
+        } else {
+            std::memcpy(buffer_ + used_, data, size);
+            used_ += size;
+        }
+    }
+
+    void write(const std::string &str) { write(str.data(), str.size()); }
+
+    void put(char c) {
+        if (used_ == capacity_) {
+            flush();
+        }
+        buffer_[used_++] = c;
+    }
+
+    void write_uint(unsigned long long value);
+
+    /// bytes that can still be written before the block is handed to the sink
+    std::size_t available() const { return capacity_ - used_; }
+
+    /// hands the buffered bytes to the sink
+    void flush();
+
+    /// flushes and closes the underlying sink; further writes are not allowed
+    void close();
+
+private:
+    void write_slow(const char *data, std::size_t size);
+
+private:
+    std::unique_ptr<OutputSink> sink_;
+    // only used when the sink does not lend its own buffers
+    std::vector<char> storage_;
+    char *buffer_;
+    std::size_t capacity_;
+    std::size_t used_ = 0;
+    bool closed_ = false;
+};
+
+/// Consumer of recombined sequences, called once per record in generation order
+class RecordWriter {
+public:
+    virtual ~RecordWriter() = default;
+
+    virtual void write(std::size_t index, const immulator::Recombination &record) = 0;
+
+    /// receives a whole batch of consecutive records at once (the first one being first); writers that work better
+    /// on many records at a time override this, the default writes them one by one
+    virtual void write_batch(std::size_t first, const std::vector<immulator::Recombination> &records) {
+        for (std::size_t i = 0; i < records.size(); ++i) {
+            write(first + i, records[i]);
+        }
+    }
+
+    /// pushes out whatever is still pending; called once, after the last record
+    virtual void close() {}
+};
+
+/// Writes recombined sequences as FASTA records: >index|names, followed by the (optionally wrapped) sequence
+class FastaWriter : public RecordWriter {
+public:
+    /// \param out buffered output stream
+    /// \param line_width wrap sequence lines at this many characters, 0 writes the sequence on a single line
+    explicit FastaWriter(BufferedWriter &out, std::size_t line_width = 0) : out_(out), line_width_(line_width) {}
+
+    void write(std::size_t index, const immulator::Recombination &record) override;
+
+    /// upper bound of the formatted size of a record
+    /// \param name_size length of the V, D and J names together
+    /// \param seq_size sequence length
+    /// \param line_width as given to the constructor
+    static std::size_t max_record_size(std::size_t name_size, std::size_t seq_size, std::size_t line_width = 0);
+
+private:
+    void write_wrapped(const char *data, std::size_t size, std::size_t &column);
+
+private:
+    BufferedWriter &out_;
+    std::size_t line_width_;
+};
+
+/// Writes the translated sequences as protein FASTA records, with the same headers as FastaWriter. Every record is
+/// assembled into one scratch buffer (codons may span the V, junction and J) and translated with translate_codons.
+class ProteinFastaWriter : public RecordWriter {
+public:
+    /// \param out buffered output stream
+    /// \param line_width wrap sequence lines at this many characters, 0 writes the sequence on a single line
+    explicit ProteinFastaWriter(BufferedWriter &out, std::size_t line_width = 0) :
+            out_(out), line_width_(line_width) {}
+
+    void write(std::size_t index, const immulator::Recombination &record) override;
+
+private:
+    void write_record(std::size_t index, const immulator::Recombination &record, const char *protein,
+                      std::size_t size);
+
+private:
+    BufferedWriter &out_;
+    std::size_t line_width_;
+    // nucleotides and amino acids of the current record, reused so that no record allocates
+    std::vector<char> nucleotides_;
+    std::vector<char> proteins_;
+};
+
+/// Writes the same FASTA records as FastaWriter (without line wrapping), but with writev(2): V and J bodies are
+/// referenced straight from the germline pool and only the headers and junctions are copied, into a small arena
+class GatherFastaWriter : public RecordWriter {
+public:
+    static constexpr std::size_t DEFAULT_ARENA_SIZE = 1 << 20;
+
+    /// \param fd descriptor to write to; not closed by this writer
+    /// \param arena_size bytes reserved for headers and junctions between two writev calls
+    explicit GatherFastaWriter(int fd, std::size_t arena_size = DEFAULT_ARENA_SIZE);
+
+    ~GatherFastaWriter() override;
+
+    void write(std::size_t index, const immulator::Recombination &record) override;
+
+    void close() override { flush(); }
+
+    void flush();
+
+private:
+    /// copies into the arena, merging with the previous slice when they are adjacent
+    void copy(const char *data, std::size_t size);
+
+    /// references data in place (it must outlive the next flush)
+    void refer(const char *data, std::size_t size);
+
+private:
+    int fd_;
+    std::vector<char> arena_;
+    std::size_t used_ = 0;
+    std::vector<iovec> iov_;
+    std::size_t max_iov_;
+};
+
+/// Writes the germline and CDR3 truth table (Genes,CDR3.start,CDR3.end)
+class ReferenceWriter : public RecordWriter {
+public:
+    static constexpr const char HEADER[] = "Genes,CDR3.start,CDR3.end\n";
+
+    /// \param out buffered output stream
+    /// \param write_header write the CSV header before the first row
+    explicit ReferenceWriter(BufferedWriter &out, bool write_header = true) :
+            out_(out), header_written_(!write_header) {}
+
+    void write(std::size_t index, const immulator::Recombination &record) override;
+
+    /// upper bound of the formatted size of a row
+    /// \param name_size length of the V, D and J names together
+    static std::size_t max_record_size(std::size_t name_size);
+
+    /// exact formatted size of the row written for record
+    static std::size_t record_size(const immulator::Recombination &record);
+
+private:
+    BufferedWriter &out_;
+    bool header_written_ = false;
+};
+
+}   // namespace immulator
+
+
+#endif //IMMULATOR_WRITER_H